@@ -0,0 +1,791 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * ddr_bench - latency and throughput of every way this project reaches a
+ * register: the single-word ioctls, DDR_IO, DDR_READ_RANGE, DDR_READ_SG,
+ * the /dev/ddr mmap window, /dev/mem (as read_write_from_reg/mem_read.c
+ * does it) and the HTTPS virtual register server.
+ *
+ * Each test runs warmup untimed iterations, then times every iteration
+ * and reports min/p50/p90/p99/max. Latency tests time one word per
+ * iteration; seq/stride/random time one sweep of the region and report
+ * MB/s from the median sweep. Load ddr.ko with backend=sim to run the
+ * kernel paths without hardware; its defaults match the server's window.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#ifdef DDR_BENCH_REST
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif
+
+#include "../ddr_ioctl.h"
+
+#define DDR_PARAM_DIR "/sys/module/ddr/parameters/"
+
+enum test {
+    T_LAT_READ,
+    T_LAT_WRITE,
+    T_SEQ,
+    T_STRIDE,
+    T_RANDOM,
+    T_COUNT,
+};
+
+static const char *const test_names[T_COUNT] = {
+    "lat_read", "lat_write", "seq", "stride", "random",
+};
+
+enum fmt { FMT_TEXT, FMT_CSV, FMT_JSON };
+
+struct ctx {
+    uint64_t base;
+    size_t size;
+    int fd;                     // /dev/ddr
+    int mem_fd;                 // /dev/mem
+    volatile uint32_t *win;     // mapping used by the mmap/devmem paths
+    size_t win_len;
+    size_t win_off;
+#ifdef DDR_BENCH_REST
+    const char *host;
+    const char *port;
+    SSL_CTX *ssl_ctx;
+    SSL *ssl;
+    SSL_SESSION *session;
+    int sock;
+    char *resp;
+    size_t resp_cap;
+#endif
+};
+
+/*
+ * A path needs read1; write1 and clear1 are optional (NULL skips
+ * lat_write). readv reads n words at addrs, contiguous when the caller
+ * knows addrs[i] = addrs[0] + 4 * i; NULL falls back to read1 per word.
+ * Return 0, or -ENOTSUP to skip the test.
+ */
+struct path {
+    const char *name;
+    int (*open)(struct ctx *c);
+    void (*close)(struct ctx *c);
+    int (*read1)(struct ctx *c, uint64_t addr, uint32_t *v);
+    int (*write1)(struct ctx *c, uint64_t addr, uint32_t v);
+    int (*clear1)(struct ctx *c, uint64_t addr);
+    int (*readv)(struct ctx *c, const uint64_t *addrs, size_t n, uint32_t *out, int contig);
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int read_param(const char *name, unsigned long *value)
+{
+    char path[128];
+    FILE *f;
+    int ok;
+
+    snprintf(path, sizeof(path), DDR_PARAM_DIR "%s", name);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    ok = fscanf(f, "%lu", value) == 1;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+static int xioctl(struct ctx *c, unsigned long cmd, void *arg)
+{
+    return ioctl(c->fd, cmd, arg) < 0 ? -errno : 0;
+}
+
+/* ---- /dev/ddr ioctl paths ---- */
+
+static int ddr_dev_open(struct ctx *c)
+{
+    c->fd = open(DDR_DEVICE_PATH, O_RDWR);
+    return c->fd < 0 ? -errno : 0;
+}
+
+static void ddr_dev_close(struct ctx *c)
+{
+    if (c->win)
+        munmap((void *)((uintptr_t)c->win - c->win_off), c->win_len);
+    c->win = NULL;
+    close(c->fd);
+}
+
+static int ioctl_read1(struct ctx *c, uint64_t addr, uint32_t *v)
+{
+    struct ddr_rw_args rw = { .addr = addr };
+    int ret = xioctl(c, DDR_READ, &rw);
+
+    *v = rw.value;
+    return ret;
+}
+
+static int ioctl_write1(struct ctx *c, uint64_t addr, uint32_t v)
+{
+    struct ddr_rw_args rw = { .addr = addr, .value = v };
+
+    return xioctl(c, DDR_WRITE, &rw);
+}
+
+// Writes are write-once, so every timed write is preceded by an untimed clear
+static int ioctl_clear1(struct ctx *c, uint64_t addr)
+{
+    struct ddr_batch_op op = { .addr = addr, .op = DDR_OP_CLEAR };
+    struct ddr_batch_args args = { .ops = (uintptr_t)&op, .count = 1, .failed = -1 };
+
+    return xioctl(c, DDR_BATCH, &args);
+}
+
+static int io_read1(struct ctx *c, uint64_t addr, uint32_t *v)
+{
+    struct ddr_io io = { .size = sizeof(io), .op = DDR_IO_READ, .addr = addr, .count = 1 };
+    int ret = xioctl(c, DDR_IO, &io);
+
+    *v = (uint32_t)io.value;
+    return ret;
+}
+
+static int io_write1(struct ctx *c, uint64_t addr, uint32_t v)
+{
+    struct ddr_io io = { .size = sizeof(io), .op = DDR_IO_WRITE, .addr = addr,
+                         .value = v, .count = 1 };
+
+    return xioctl(c, DDR_IO, &io);
+}
+
+static int io_readv(struct ctx *c, const uint64_t *addrs, size_t n, uint32_t *out, int contig)
+{
+    struct ddr_io io = { .size = sizeof(io), .op = DDR_IO_READ };
+    size_t i;
+    int ret;
+
+    if (contig) {
+        io.addr = addrs[0];
+        io.buf = (uintptr_t)out;
+        io.count = n;
+        return xioctl(c, DDR_IO, &io);
+    }
+    for (i = 0; i < n; i++) {
+        ret = io_read1(c, addrs[i], &out[i]);
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+static int range_readv(struct ctx *c, const uint64_t *addrs, size_t n, uint32_t *out, int contig)
+{
+    static struct ddr_range_args range;
+    size_t i, k;
+    int ret;
+
+    if (!contig)
+        return -ENOTSUP;
+    for (i = 0; i < n; i += k) {
+        k = n - i < DDR_RANGE_MAX ? n - i : DDR_RANGE_MAX;
+        range.addr = addrs[i];
+        range.count = k;
+        ret = xioctl(c, DDR_READ_RANGE, &range);
+        if (ret)
+            return ret;
+        memcpy(out + i, range.values, k * 4);
+    }
+    return 0;
+}
+
+static int range_read1(struct ctx *c, uint64_t addr, uint32_t *v)
+{
+    return range_readv(c, &addr, 1, v, 1);
+}
+
+static int sg_readv(struct ctx *c, const uint64_t *addrs, size_t n, uint32_t *out, int contig)
+{
+    struct ddr_xfer_args xfer = { .addr = addrs[0], .count = n, .buf = (uintptr_t)out };
+    static struct ddr_seg *segs;
+    static size_t nsegs;
+    size_t i;
+
+    // scattered words become a one-word segment each
+    if (!contig) {
+        if (nsegs < n) {
+            free(segs);
+            segs = malloc(n * sizeof(*segs));
+            if (!segs)
+                return -ENOMEM;
+            nsegs = n;
+        }
+        for (i = 0; i < n; i++) {
+            segs[i].addr = addrs[i];
+            segs[i].count = 1;
+        }
+        xfer.segs = (uintptr_t)segs;
+        xfer.nsegs = n;
+    }
+    return xioctl(c, DDR_READ_SG, &xfer);
+}
+
+static int sg_read1(struct ctx *c, uint64_t addr, uint32_t *v)
+{
+    return sg_readv(c, &addr, 1, v, 1);
+}
+
+/* ---- mapped paths ---- */
+
+static int map_window(struct ctx *c, int fd, uint64_t phys)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    void *p;
+
+    c->win_off = phys & (page - 1);
+    c->win_len = c->size + c->win_off;
+    p = mmap(NULL, c->win_len, PROT_READ, MAP_SHARED, fd, phys - c->win_off);
+    if (p == MAP_FAILED)
+        return -errno;
+    c->win = (volatile uint32_t *)((char *)p + c->win_off);
+    return 0;
+}
+
+static int mmap_open(struct ctx *c)
+{
+    unsigned long base, size;
+    int ret = ddr_dev_open(c);
+
+    if (ret)
+        return ret;
+    if (read_param("mmap_base", &base) || read_param("mmap_size", &size) || !size ||
+        c->base < base || c->base + c->size > base + size) {
+        close(c->fd);
+        return -ENOTSUP;
+    }
+    ret = map_window(c, c->fd, c->base);
+    if (ret)
+        close(c->fd);
+    return ret;
+}
+
+static int devmem_open(struct ctx *c)
+{
+    int ret;
+
+    c->mem_fd = open("/dev/mem", O_RDONLY | O_SYNC);
+    if (c->mem_fd < 0)
+        return -errno;
+    ret = map_window(c, c->mem_fd, c->base);
+    if (ret)
+        close(c->mem_fd);
+    return ret;
+}
+
+static void devmem_close(struct ctx *c)
+{
+    munmap((void *)((uintptr_t)c->win - c->win_off), c->win_len);
+    c->win = NULL;
+    close(c->mem_fd);
+}
+
+static int map_read1(struct ctx *c, uint64_t addr, uint32_t *v)
+{
+    *v = c->win[(addr - c->base) / 4];
+    return 0;
+}
+
+static int map_readv(struct ctx *c, const uint64_t *addrs, size_t n, uint32_t *out, int contig)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        out[i] = c->win[(addrs[i] - c->base) / 4];
+    (void)contig;
+    return 0;
+}
+
+/* ---- HTTPS virtual register server ---- */
+
+#ifdef DDR_BENCH_REST
+static void rest_disconnect(struct ctx *c)
+{
+    if (c->ssl) {
+        SSL_shutdown(c->ssl);
+        SSL_free(c->ssl);
+        c->ssl = NULL;
+    }
+    if (c->sock >= 0)
+        close(c->sock);
+    c->sock = -1;
+}
+
+static int rest_connect(struct ctx *c)
+{
+    struct addrinfo hints = { .ai_socktype = SOCK_STREAM }, *res, *ai;
+
+    if (getaddrinfo(c->host, c->port, &hints, &res))
+        return -EHOSTUNREACH;
+    c->sock = -1;
+    for (ai = res; ai; ai = ai->ai_next) {
+        c->sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (c->sock < 0)
+            continue;
+        if (connect(c->sock, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(c->sock);
+        c->sock = -1;
+    }
+    freeaddrinfo(res);
+    if (c->sock < 0)
+        return -ECONNREFUSED;
+
+    // resume the previous session so reconnects skip the full handshake
+    c->ssl = SSL_new(c->ssl_ctx);
+    SSL_set_fd(c->ssl, c->sock);
+    SSL_set_tlsext_host_name(c->ssl, c->host);
+    if (c->session)
+        SSL_set_session(c->ssl, c->session);
+    if (SSL_connect(c->ssl) != 1) {
+        rest_disconnect(c);
+        return -ECONNABORTED;
+    }
+    if (c->session)
+        SSL_SESSION_free(c->session);
+    c->session = SSL_get1_session(c->ssl);
+    return 0;
+}
+
+/*
+ * One request, reconnecting first if the server closed the previous
+ * connection (the Flask development server answers HTTP/1.0). The body
+ * is left NUL-terminated in c->resp.
+ */
+static int rest_request(struct ctx *c, const char *method, const char *target,
+                        const char *body)
+{
+    char req[512], *hdr_end, *p;
+    size_t len = 0, need = 0;
+    int n, status, keep = 0, ret;
+
+    if (c->sock < 0 && (ret = rest_connect(c)))
+        return ret;
+
+    n = snprintf(req, sizeof(req),
+                 "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n"
+                 "Content-Type: application/json\r\nContent-Length: %zu\r\n\r\n%s",
+                 method, target, c->host, body ? strlen(body) : 0, body ? body : "");
+    if (SSL_write(c->ssl, req, n) != n) {
+        rest_disconnect(c);
+        return -EPIPE;
+    }
+
+    for (;;) {
+        if (len + 4096 + 1 > c->resp_cap) {
+            c->resp_cap = (len + 4096 + 1) * 2;
+            c->resp = realloc(c->resp, c->resp_cap);
+        }
+        n = SSL_read(c->ssl, c->resp + len, c->resp_cap - len - 1);
+        if (n <= 0)
+            break;
+        len += n;
+        c->resp[len] = '\0';
+
+        hdr_end = strstr(c->resp, "\r\n\r\n");
+        if (!hdr_end)
+            continue;
+        if (!need) {
+            p = strcasestr(c->resp, "\r\nContent-Length:");
+            if (!p || p > hdr_end)
+                continue;   // read to EOF
+            need = (hdr_end + 4 - c->resp) + strtoul(p + 17, NULL, 10);
+            keep = strncmp(c->resp, "HTTP/1.1", 8) == 0 &&
+                   !strcasestr(c->resp, "\r\nConnection: close");
+        }
+        if (len >= need)
+            break;
+    }
+    if (!keep)
+        rest_disconnect(c);
+
+    if (len < 12 || sscanf(c->resp, "HTTP/%*s %d", &status) != 1)
+        return -EPROTO;
+    hdr_end = strstr(c->resp, "\r\n\r\n");
+    if (hdr_end)
+        memmove(c->resp, hdr_end + 4, strlen(hdr_end + 4) + 1);
+    return status == 200 ? 0 : -EIO;
+}
+
+static int rest_open(struct ctx *c)
+{
+    if (!c->host)
+        return -ENOTSUP;
+    c->ssl_ctx = SSL_CTX_new(TLS_client_method());
+    if (!c->ssl_ctx)
+        return -ENOMEM;
+    // the server certificate is self-signed (make_certs.sh)
+    SSL_CTX_set_verify(c->ssl_ctx, SSL_VERIFY_NONE, NULL);
+    c->sock = -1;
+    return rest_connect(c);
+}
+
+static void rest_close(struct ctx *c)
+{
+    rest_disconnect(c);
+    if (c->session)
+        SSL_SESSION_free(c->session);
+    c->session = NULL;
+    SSL_CTX_free(c->ssl_ctx);
+    free(c->resp);
+    c->resp = NULL;
+    c->resp_cap = 0;
+}
+
+static int rest_read1(struct ctx *c, uint64_t addr, uint32_t *v)
+{
+    char target[128], *p;
+    int ret;
+
+    snprintf(target, sizeof(target), "/api/v1/read?addr=0x%llx&width=4",
+             (unsigned long long)addr);
+    ret = rest_request(c, "GET", target, NULL);
+    if (ret)
+        return ret;
+    p = strstr(c->resp, "\"value\"");
+    *v = p ? strtoul(strchr(p + 7, '"') + 1, NULL, 0) : 0;
+    return 0;
+}
+
+static int rest_write1(struct ctx *c, uint64_t addr, uint32_t v)
+{
+    char body[128];
+
+    snprintf(body, sizeof(body), "{\"addr\":\"0x%llx\",\"width\":4,\"value\":\"0x%x\"}",
+             (unsigned long long)addr, v);
+    return rest_request(c, "POST", "/api/v1/write", body);
+}
+
+static int rest_clear1(struct ctx *c, uint64_t addr)
+{
+    char target[128];
+
+    snprintf(target, sizeof(target), "/api/v1/clear?addr=0x%llx&width=4",
+             (unsigned long long)addr);
+    return rest_request(c, "GET", target, NULL);
+}
+
+static int rest_readv(struct ctx *c, const uint64_t *addrs, size_t n, uint32_t *out, int contig)
+{
+    char target[160];
+    size_t i;
+    int ret;
+
+    if (!contig) {
+        for (i = 0; i < n; i++) {
+            ret = rest_read1(c, addrs[i], &out[i]);
+            if (ret)
+                return ret;
+        }
+        return 0;
+    }
+    // the JSON body is not parsed back: only the transfer is being timed
+    snprintf(target, sizeof(target), "/api/v1/read_range?start=0x%llx&count=%zu&width=4",
+             (unsigned long long)addrs[0], n);
+    return rest_request(c, "GET", target, NULL);
+}
+#endif
+
+static const struct path paths[] = {
+    { "ioctl",  ddr_dev_open, ddr_dev_close, ioctl_read1, ioctl_write1, ioctl_clear1, NULL },
+    { "io",     ddr_dev_open, ddr_dev_close, io_read1, io_write1, ioctl_clear1, io_readv },
+    { "range",  ddr_dev_open, ddr_dev_close, range_read1, NULL, NULL, range_readv },
+    { "sg",     ddr_dev_open, ddr_dev_close, sg_read1, NULL, NULL, sg_readv },
+    { "mmap",   mmap_open, ddr_dev_close, map_read1, NULL, NULL, map_readv },
+    { "devmem", devmem_open, devmem_close, map_read1, NULL, NULL, map_readv },
+#ifdef DDR_BENCH_REST
+    { "rest",   rest_open, rest_close, rest_read1, rest_write1, rest_clear1, rest_readv },
+#endif
+};
+
+#define NPATHS (sizeof(paths) / sizeof(paths[0]))
+
+struct result {
+    const char *path;
+    const char *test;
+    size_t samples;
+    size_t words;       // per sample
+    uint64_t min, p50, p90, p99, max, mean;
+    double mbps;
+};
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void summarize(struct result *r, uint64_t *ns, size_t n)
+{
+    uint64_t sum = 0;
+    size_t i;
+
+    qsort(ns, n, sizeof(*ns), cmp_u64);
+    for (i = 0; i < n; i++)
+        sum += ns[i];
+    r->samples = n;
+    r->min = ns[0];
+    r->p50 = ns[(n - 1) * 50 / 100];
+    r->p90 = ns[(n - 1) * 90 / 100];
+    r->p99 = ns[(n - 1) * 99 / 100];
+    r->max = ns[n - 1];
+    r->mean = sum / n;
+    r->mbps = r->p50 ? r->words * 4 * 1e3 / r->p50 : 0;
+}
+
+static uint64_t rng_next(uint64_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+struct opts {
+    size_t iters;
+    size_t warmup;
+    size_t reps;
+    size_t stride;
+    uint64_t seed;
+};
+
+/* Run one test on an open path; 0, -ENOTSUP to skip, or -errno. */
+static int run_test(struct ctx *c, const struct path *p, enum test t, const struct opts *o,
+                    struct result *r)
+{
+    size_t words = c->size / 4, n, i, k, total;
+    uint64_t *addrs, *ns, start, s = o->seed;
+    uint32_t *buf, v;
+    int contig = t == T_SEQ, ret = 0;
+
+    if (t == T_LAT_WRITE && (!p->write1 || !p->clear1))
+        return -ENOTSUP;
+
+    n = t == T_STRIDE ? (c->size + o->stride - 1) / o->stride : words;
+    addrs = malloc(n * sizeof(*addrs));
+    buf = malloc(n * sizeof(*buf));
+    total = (t <= T_LAT_WRITE ? o->iters : o->reps);
+    ns = malloc(total * sizeof(*ns));
+    if (!addrs || !buf || !ns) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    for (i = 0; i < n; i++)
+        addrs[i] = c->base + (t == T_STRIDE ? i * o->stride : i * 4);
+    if (t == T_RANDOM || t <= T_LAT_WRITE) {
+        // Fisher-Yates, so every word is hit once per sweep in random order
+        for (i = n - 1; i > 0; i--) {
+            k = rng_next(&s) % (i + 1);
+            start = addrs[i];
+            addrs[i] = addrs[k];
+            addrs[k] = start;
+        }
+    }
+
+    r->path = p->name;
+    r->test = test_names[t];
+    r->words = t <= T_LAT_WRITE ? 1 : n;
+
+    for (i = 0; i < o->warmup + total; i++) {
+        uint64_t addr = addrs[i % n];
+
+        if (t == T_LAT_WRITE && (ret = p->clear1(c, addr)))
+            break;
+        start = now_ns();
+        if (t == T_LAT_READ)
+            ret = p->read1(c, addr, &v);
+        else if (t == T_LAT_WRITE)
+            ret = p->write1(c, addr, 0xa5a5a5a5u);
+        else if (p->readv)
+            ret = p->readv(c, addrs, n, buf, contig);
+        else
+            for (k = 0; k < n && !ret; k++)
+                ret = p->read1(c, addrs[k], &buf[k]);
+        if (ret)
+            break;
+        if (i >= o->warmup)
+            ns[i - o->warmup] = now_ns() - start;
+    }
+    if (!ret)
+        summarize(r, ns, total);
+out:
+    free(addrs);
+    free(buf);
+    free(ns);
+    return ret;
+}
+
+static void print_header(enum fmt fmt)
+{
+    if (fmt == FMT_CSV)
+        printf("path,test,samples,words,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns,mbps\n");
+    else if (fmt == FMT_JSON)
+        printf("[");
+    else
+        printf("%-7s %-9s %8s %7s %10s %10s %10s %10s %10s %10s\n", "path", "test", "samples",
+               "words", "min_ns", "p50_ns", "p90_ns", "p99_ns", "max_ns", "MB/s");
+}
+
+static void print_result(enum fmt fmt, const struct result *r, int first)
+{
+    if (fmt == FMT_CSV) {
+        printf("%s,%s,%zu,%zu,%llu,%llu,%llu,%llu,%llu,%llu,%.2f\n", r->path, r->test,
+               r->samples, r->words, (unsigned long long)r->min, (unsigned long long)r->p50,
+               (unsigned long long)r->p90, (unsigned long long)r->p99,
+               (unsigned long long)r->max, (unsigned long long)r->mean, r->mbps);
+    } else if (fmt == FMT_JSON) {
+        printf("%s\n  {\"path\": \"%s\", \"test\": \"%s\", \"samples\": %zu, \"words\": %zu, "
+               "\"min_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, "
+               "\"max_ns\": %llu, \"mean_ns\": %llu, \"mbps\": %.2f}",
+               first ? "" : ",", r->path, r->test, r->samples, r->words,
+               (unsigned long long)r->min, (unsigned long long)r->p50,
+               (unsigned long long)r->p90, (unsigned long long)r->p99,
+               (unsigned long long)r->max, (unsigned long long)r->mean, r->mbps);
+    } else {
+        printf("%-7s %-9s %8zu %7zu %10llu %10llu %10llu %10llu %10llu %10.2f\n", r->path,
+               r->test, r->samples, r->words, (unsigned long long)r->min,
+               (unsigned long long)r->p50, (unsigned long long)r->p90,
+               (unsigned long long)r->p99, (unsigned long long)r->max, r->mbps);
+    }
+}
+
+// Is name in the comma-separated list (NULL list = everything)?
+static int listed(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+    const char *p;
+
+    if (!list)
+        return 1;
+    for (p = list; (p = strstr(p, name)); p += len)
+        if ((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0'))
+            return 1;
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -p paths   ioctl,io,range,sg,mmap,devmem,rest (default: all available)\n"
+            "  -t tests   lat_read,lat_write,seq,stride,random (default: all)\n"
+            "  -a addr    physical base (default 0x80000000, the sim/server window)\n"
+            "  -s size    region in bytes (default 0x10000)\n"
+            "  -n iters   latency samples (default 10000)\n"
+            "  -r reps    sweeps per throughput test (default 20)\n"
+            "  -w warmup  untimed iterations before each test (default 100)\n"
+            "  -S stride  stride test step in bytes (default 64)\n"
+            "  -x seed    random order seed (default 1)\n"
+            "  -u host:port  virtual register server (enables the rest path)\n"
+            "  -o fmt     text, csv or json (default text)\n"
+            "lat_write overwrites the region (each word is cleared first).\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    struct opts o = { .iters = 10000, .warmup = 100, .reps = 20, .stride = 64, .seed = 1 };
+    struct ctx c = { .base = 0x80000000, .size = 0x10000, .fd = -1, .mem_fd = -1 };
+    const char *path_list = NULL, *test_list = NULL;
+    enum fmt fmt = FMT_TEXT;
+    struct result r;
+    char *colon;
+    size_t i;
+    int opt, t, ret, first = 1, failed = 0;
+
+    while ((opt = getopt(argc, argv, "p:t:a:s:n:r:w:S:x:u:o:h")) != -1) {
+        switch (opt) {
+        case 'p': path_list = optarg; break;
+        case 't': test_list = optarg; break;
+        case 'a': c.base = strtoull(optarg, NULL, 0); break;
+        case 's': c.size = strtoull(optarg, NULL, 0); break;
+        case 'n': o.iters = strtoul(optarg, NULL, 0); break;
+        case 'r': o.reps = strtoul(optarg, NULL, 0); break;
+        case 'w': o.warmup = strtoul(optarg, NULL, 0); break;
+        case 'S': o.stride = strtoul(optarg, NULL, 0); break;
+        case 'x': o.seed = strtoull(optarg, NULL, 0); break;
+        case 'u':
+#ifdef DDR_BENCH_REST
+            colon = strrchr(optarg, ':');
+            if (!colon)
+                usage(argv[0]);
+            *colon = '\0';
+            c.host = optarg;
+            c.port = colon + 1;
+#else
+            (void)colon;
+            fprintf(stderr, "built without REST support (make REST=1)\n");
+            return 1;
+#endif
+            break;
+        case 'o':
+            if (strcmp(optarg, "csv") == 0)
+                fmt = FMT_CSV;
+            else if (strcmp(optarg, "json") == 0)
+                fmt = FMT_JSON;
+            else if (strcmp(optarg, "text") != 0)
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (c.base % 4 || c.size < 4 || c.size % 4 || !o.iters || !o.reps ||
+        !o.stride || o.stride % 4 || !o.seed)
+        usage(argv[0]);
+
+    print_header(fmt);
+    for (i = 0; i < NPATHS; i++) {
+        if (!listed(path_list, paths[i].name))
+            continue;
+        ret = paths[i].open(&c);
+        if (ret) {
+            // only complain about paths that were asked for by name
+            if (path_list || ret != -ENOTSUP)
+                fprintf(stderr, "%s: skipped (%s)\n", paths[i].name, strerror(-ret));
+            continue;
+        }
+        for (t = 0; t < T_COUNT; t++) {
+            if (!listed(test_list, test_names[t]))
+                continue;
+            ret = run_test(&c, &paths[i], t, &o, &r);
+            if (ret == -ENOTSUP)
+                continue;
+            if (ret) {
+                fprintf(stderr, "%s %s: %s\n", paths[i].name, test_names[t], strerror(-ret));
+                failed = 1;
+                continue;
+            }
+            print_result(fmt, &r, first);
+            first = 0;
+        }
+        paths[i].close(&c);
+    }
+    if (fmt == FMT_JSON)
+        printf("\n]\n");
+    return failed;
+}
@@ -9,140 +9,2291 @@
 #include <linux/device.h>
 #include <linux/ioctl.h>
 #include <linux/version.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/rwsem.h>
+#include <linux/slab.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/overflow.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/hash.h>
+#include <linux/bitmap.h>
+#include <linux/lockdep.h>
+#include <linux/vmalloc.h>
+#include <linux/string.h>
+#include <linux/hrtimer.h>
+#include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/eventfd.h>
+#include <linux/wait.h>
+#include <linux/kthread.h>
+#include <linux/math64.h>
+#include <linux/atomic.h>
+#include <linux/percpu.h>
+#include <linux/jump_label.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/compat.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/capability.h>
+#include <linux/sort.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,7,0)
+#include <linux/io_uring/cmd.h>
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5,19,0)
+#include <linux/io_uring.h>
+#endif
+
+#include "ddr_ioctl.h"
+
+#define CREATE_TRACE_POINTS
+#include "ddr_trace.h"
+
+#define DEVICE_NAME "ddr"
+#define CLASS_NAME  "ddr_class"
+
+// Batch ops are copied in and out of user space this many at a time
+#define DDR_BATCH_CHUNK 64
+
+// Write-side region locks, hashed on the physical page number
+#define DDR_LOCK_BITS    6
+#define DDR_LOCK_BUCKETS (1 << DDR_LOCK_BITS)
+// Ranges over more pages than this lock out every other writer instead
+#define DDR_LOCK_MAX_PAGES 8
+
+// Bounce buffer used to stream DDR_READ_SG/DDR_WRITE_SG transfers
+#define DDR_BOUNCE_WORDS (PAGE_SIZE / sizeof(u32))
+
+// Poll gaps below this are busy-waited rather than slept
+#define DDR_POLL_SPIN_US 10
+// interval_us 0 spins this long at most, then sleeps gaps of up to DDR_POLL_IDLE_US
+#define DDR_POLL_MAX_SPIN_US 1000
+#define DDR_POLL_IDLE_US     100
+
+// Watchlist limits; DDR_WATCH_FIFO must be a power of two
+#define DDR_WATCH_MAX           64
+#define DDR_WATCH_MIN_PERIOD_US 100
+#define DDR_WATCH_FIFO          256
+
+// Sampler node and limits
+#define DDR_SAMPLE_MINOR         1
+#define DDR_SAMPLE_NAME          "ddr_sample"
+#define DDR_SAMPLE_MAX_REGS      16
+#define DDR_SAMPLE_MIN_PERIOD_NS 10000
+#define DDR_SAMPLE_MAX_SLOTS     (1u << 20)
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Pranesh");
+MODULE_DESCRIPTION("DDR register read/write kernel module with word alignment and overwrite protection");
+MODULE_VERSION("1.0");
+
+static unsigned int map_cache_size = 16;
+module_param(map_cache_size, uint, 0444);
+MODULE_PARM_DESC(map_cache_size, "Number of ioremap windows kept mapped between accesses (0 = map per access)");
+
+static unsigned int map_window_size = PAGE_SIZE;
+module_param(map_window_size, uint, 0444);
+MODULE_PARM_DESC(map_window_size, "Size in bytes of each cached ioremap window (power of two, at least PAGE_SIZE)");
+
+/*
+ * Physical window user space may mmap() through /dev/ddr (mmap offset is
+ * the physical address). Accesses through the mapping go straight to the
+ * bus: the write-once / no-overwrite check of DDR_WRITE does not apply.
+ */
+static unsigned long mmap_base;
+module_param(mmap_base, ulong, 0444);
+MODULE_PARM_DESC(mmap_base, "Physical base of the window that may be mmap()ed (page aligned)");
+
+static unsigned long mmap_size;
+module_param(mmap_size, ulong, 0444);
+MODULE_PARM_DESC(mmap_size, "Size of the mmap() window in bytes (0 disables mmap)");
+
+static char *backend = "mmio";
+module_param(backend, charp, 0444);
+MODULE_PARM_DESC(backend, "Access backend: mmio (ioremap physical addresses) or sim (vmalloc'd memory)");
+
+static unsigned long sim_base = 0x80000000;
+module_param(sim_base, ulong, 0444);
+MODULE_PARM_DESC(sim_base, "Fake physical base address of the sim backend");
+
+static unsigned long sim_size = 0x100000;
+module_param(sim_size, ulong, 0444);
+MODULE_PARM_DESC(sim_size, "Size in bytes of the sim backend region");
+
+static unsigned int poll_timeout_us = 10000;
+module_param(poll_timeout_us, uint, 0644);
+MODULE_PARM_DESC(poll_timeout_us, "Timeout in microseconds for DDR_BATCH poll ops");
+
+static unsigned int poll_interval_us = 50;
+module_param(poll_interval_us, uint, 0644);
+MODULE_PARM_DESC(poll_interval_us, "Maximum gap in microseconds between reads of DDR_BATCH poll ops");
+
+static int ddr_major;
+static struct class *ddr_class;
+static struct device *ddr_device;
+static struct device *ddr_sample_device;
+
+/*
+ * Backend ops: how physical windows are mapped and accessed. "mmio" goes
+ * to the bus through ioremap; "sim" serves the same addresses from a
+ * vmalloc'd region so the whole ioctl surface can run without hardware.
+ */
+struct ddr_backend {
+    const char *name;
+    void __iomem *(*map)(unsigned long phys, unsigned long size);
+    void (*unmap)(void __iomem *vaddr);
+    u32 (*read32)(const void __iomem *vaddr);
+    void (*write32)(u32 value, void __iomem *vaddr);
+    // 1, 2, 4 or 8 bytes in a single bus access; 8 only on 64-bit kernels
+    u64 (*read)(const void __iomem *vaddr, unsigned int width);
+    void (*write)(u64 value, void __iomem *vaddr, unsigned int width);
+    int (*mmap)(struct vm_area_struct *vma, unsigned long phys, unsigned long size);
+};
+
+static void __iomem *ddr_mmio_map(unsigned long phys, unsigned long size)
+{
+    return ioremap(phys, size);
+}
+
+static void ddr_mmio_unmap(void __iomem *vaddr)
+{
+    iounmap(vaddr);
+}
+
+static u32 ddr_mmio_read32(const void __iomem *vaddr)
+{
+    return ioread32(vaddr);
+}
+
+static void ddr_mmio_write32(u32 value, void __iomem *vaddr)
+{
+    iowrite32(value, vaddr);
+}
+
+static u64 ddr_mmio_read(const void __iomem *vaddr, unsigned int width)
+{
+    switch (width) {
+    case 1:
+        return ioread8(vaddr);
+    case 2:
+        return ioread16(vaddr);
+#ifdef CONFIG_64BIT
+    case 8:
+        return readq(vaddr);
+#endif
+    default:
+        return ioread32(vaddr);
+    }
+}
+
+static void ddr_mmio_write(u64 value, void __iomem *vaddr, unsigned int width)
+{
+    switch (width) {
+    case 1:
+        iowrite8(value, vaddr);
+        break;
+    case 2:
+        iowrite16(value, vaddr);
+        break;
+#ifdef CONFIG_64BIT
+    case 8:
+        writeq(value, vaddr);
+        break;
+#endif
+    default:
+        iowrite32(value, vaddr);
+    }
+}
+
+static int ddr_mmio_mmap(struct vm_area_struct *vma, unsigned long phys, unsigned long size)
+{
+    vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+    return io_remap_pfn_range(vma, vma->vm_start, phys >> PAGE_SHIFT, size,
+                              vma->vm_page_prot);
+}
+
+static const struct ddr_backend ddr_backend_mmio = {
+    .name    = "mmio",
+    .map     = ddr_mmio_map,
+    .unmap   = ddr_mmio_unmap,
+    .read32  = ddr_mmio_read32,
+    .write32 = ddr_mmio_write32,
+    .read    = ddr_mmio_read,
+    .write   = ddr_mmio_write,
+    .mmap    = ddr_mmio_mmap,
+};
+
+static void *sim_mem;
+
+static void __iomem *ddr_sim_map(unsigned long phys, unsigned long size)
+{
+    if (phys < sim_base || size > sim_size || phys - sim_base > sim_size - size)
+        return NULL;
+    return (void __force __iomem *)(sim_mem + (phys - sim_base));
+}
+
+static void ddr_sim_unmap(void __iomem *vaddr)
+{
+}
+
+static u32 ddr_sim_read32(const void __iomem *vaddr)
+{
+    return READ_ONCE(*(const u32 __force *)vaddr);
+}
+
+static void ddr_sim_write32(u32 value, void __iomem *vaddr)
+{
+    WRITE_ONCE(*(u32 __force *)vaddr, value);
+}
+
+static u64 ddr_sim_read(const void __iomem *vaddr, unsigned int width)
+{
+    switch (width) {
+    case 1:
+        return READ_ONCE(*(const u8 __force *)vaddr);
+    case 2:
+        return READ_ONCE(*(const u16 __force *)vaddr);
+#ifdef CONFIG_64BIT
+    case 8:
+        return READ_ONCE(*(const u64 __force *)vaddr);
+#endif
+    default:
+        return READ_ONCE(*(const u32 __force *)vaddr);
+    }
+}
+
+static void ddr_sim_write(u64 value, void __iomem *vaddr, unsigned int width)
+{
+    switch (width) {
+    case 1:
+        WRITE_ONCE(*(u8 __force *)vaddr, value);
+        break;
+    case 2:
+        WRITE_ONCE(*(u16 __force *)vaddr, value);
+        break;
+#ifdef CONFIG_64BIT
+    case 8:
+        WRITE_ONCE(*(u64 __force *)vaddr, value);
+        break;
+#endif
+    default:
+        WRITE_ONCE(*(u32 __force *)vaddr, value);
+    }
+}
+
+static int ddr_sim_mmap(struct vm_area_struct *vma, unsigned long phys, unsigned long size)
+{
+    if (phys < sim_base || size > sim_size || phys - sim_base > sim_size - size)
+        return -EPERM;
+    return remap_vmalloc_range(vma, sim_mem, (phys - sim_base) >> PAGE_SHIFT);
+}
+
+static const struct ddr_backend ddr_backend_sim = {
+    .name    = "sim",
+    .map     = ddr_sim_map,
+    .unmap   = ddr_sim_unmap,
+    .read32  = ddr_sim_read32,
+    .write32 = ddr_sim_write32,
+    .read    = ddr_sim_read,
+    .write   = ddr_sim_write,
+    .mmap    = ddr_sim_mmap,
+};
+
+static const struct ddr_backend *ddr_be = &ddr_backend_mmio;
+
+static inline u32 ddr_read32(const void __iomem *vaddr)
+{
+    return ddr_be->read32(vaddr);
+}
+
+static inline void ddr_write32(u32 value, void __iomem *vaddr)
+{
+    ddr_be->write32(value, vaddr);
+}
+
+/* Access widths DDR_IO accepts; 8 needs a native 64-bit bus access. */
+static inline bool ddr_width_ok(unsigned int width)
+{
+    return width == 1 || width == 2 || width == 4 ||
+           (IS_ENABLED(CONFIG_64BIT) && width == 8);
+}
+
+/*
+ * Latency statistics, off unless enabled through debugfs
+ * (/sys/kernel/debug/ddr/enable); while off every hook is a patched-out
+ * branch. Each ioctl command gets a histogram of its total time and each
+ * phase one of the time spent in it across all commands: map is a
+ * map-cache lookup including any ioremap, lock is waiting for region
+ * locks, access is the MMIO loop of a read/write (it contains its map
+ * lookups), copy is copy_{from,to}_user. Buckets are log2 nanoseconds.
+ */
+#define DDR_STAT_CMDS    13     // indexed by _IOC_NR, 0 collects unknown commands
+#define DDR_STAT_BUCKETS 32
+
+enum ddr_phase {
+    DDR_PHASE_MAP,
+    DDR_PHASE_LOCK,
+    DDR_PHASE_ACCESS,
+    DDR_PHASE_COPY,
+    DDR_PHASES,
+};
+
+static const char *const ddr_cmd_names[DDR_STAT_CMDS] = {
+    "other", "read", "write", "read_range", "write_range", "read_sg", "write_sg",
+    "batch", "poll", "watch", "sample", "io", "memtest",
+};
+
+static const char *const ddr_phase_names[DDR_PHASES] = {
+    "map", "lock", "access", "copy",
+};
+
+struct ddr_stat_hist {
+    u64 count;
+    u64 errors;
+    u64 total_ns;
+    u64 buckets[DDR_STAT_BUCKETS];
+};
+
+struct ddr_stats {
+    struct ddr_stat_hist cmd[DDR_STAT_CMDS];
+    struct ddr_stat_hist phase[DDR_PHASES];
+};
+
+static struct ddr_stats __percpu *ddr_stats;
+static DEFINE_STATIC_KEY_FALSE(ddr_stats_on);
+static struct dentry *ddr_debugfs;
+
+static __always_inline u64 ddr_stat_start(void)
+{
+    return static_branch_unlikely(&ddr_stats_on) ? ktime_get_ns() : 0;
+}
+
+static void ddr_stat_record(struct ddr_stat_hist __percpu *h, u64 start, bool error)
+{
+    u64 ns = ktime_get_ns() - start;
+    unsigned int b = ns ? min_t(unsigned int, ilog2(ns), DDR_STAT_BUCKETS - 1) : 0;
+
+    this_cpu_inc(h->count);
+    if (error)
+        this_cpu_inc(h->errors);
+    this_cpu_add(h->total_ns, ns);
+    this_cpu_inc(h->buckets[b]);
+}
+
+/* A start of 0 means stats were off when the section began. */
+static __always_inline void ddr_stat_phase(enum ddr_phase phase, u64 start)
+{
+    if (static_branch_unlikely(&ddr_stats_on) && start)
+        ddr_stat_record(&ddr_stats->phase[phase], start, false);
+}
+
+static __always_inline void ddr_stat_cmd(unsigned int cmd, u64 start, long ret)
+{
+    unsigned int nr = _IOC_NR(cmd);
+
+    if (static_branch_unlikely(&ddr_stats_on) && start)
+        ddr_stat_record(&ddr_stats->cmd[nr < DDR_STAT_CMDS ? nr : 0], start, ret < 0);
+}
+
+static unsigned long ddr_copy_from_user(void *to, const void __user *from, unsigned long n)
+{
+    u64 t = ddr_stat_start();
+    unsigned long ret = copy_from_user(to, from, n);
+
+    ddr_stat_phase(DDR_PHASE_COPY, t);
+    return ret;
+}
+
+static unsigned long ddr_copy_to_user(void __user *to, const void *from, unsigned long n)
+{
+    u64 t = ddr_stat_start();
+    unsigned long ret = copy_to_user(to, from, n);
+
+    ddr_stat_phase(DDR_PHASE_COPY, t);
+    return ret;
+}
+
+/* Start time for a ddr_op tracepoint, 0 while the event is off. */
+static __always_inline u64 ddr_trace_start(void)
+{
+    return trace_ddr_op_enabled() ? ktime_get_ns() : 0;
+}
+
+static void ddr_stats_sum(const struct ddr_stat_hist *(*pick)(const struct ddr_stats *, int),
+                          int idx, struct ddr_stat_hist *sum)
+{
+    const struct ddr_stat_hist *h;
+    int cpu, b;
+
+    memset(sum, 0, sizeof(*sum));
+    for_each_possible_cpu(cpu) {
+        h = pick(per_cpu_ptr(ddr_stats, cpu), idx);
+        sum->count += h->count;
+        sum->errors += h->errors;
+        sum->total_ns += h->total_ns;
+        for (b = 0; b < DDR_STAT_BUCKETS; b++)
+            sum->buckets[b] += h->buckets[b];
+    }
+}
+
+static const struct ddr_stat_hist *ddr_pick_cmd(const struct ddr_stats *st, int i)
+{
+    return &st->cmd[i];
+}
+
+static const struct ddr_stat_hist *ddr_pick_phase(const struct ddr_stats *st, int i)
+{
+    return &st->phase[i];
+}
+
+static void ddr_stats_show_one(struct seq_file *m, const char *kind, const char *name,
+                               const struct ddr_stat_hist *h)
+{
+    int b;
+
+    seq_printf(m, "%s %s %llu %llu %llu", kind, name, h->count, h->errors, h->total_ns);
+    for (b = 0; b < DDR_STAT_BUCKETS; b++)
+        seq_printf(m, " %llu", h->buckets[b]);
+    seq_putc(m, '\n');
+}
+
+/*
+ * One line per command and phase:
+ *   <cmd|phase> <name> <count> <errors> <total_ns> <bucket0> ... <bucket31>
+ * where bucket b counts samples of [2^b, 2^(b+1)) ns.
+ */
+static int ddr_stats_show(struct seq_file *m, void *v)
+{
+    struct ddr_stat_hist sum;
+    int i;
+
+    for (i = 0; i < DDR_STAT_CMDS; i++) {
+        ddr_stats_sum(ddr_pick_cmd, i, &sum);
+        ddr_stats_show_one(m, "cmd", ddr_cmd_names[i], &sum);
+    }
+    for (i = 0; i < DDR_PHASES; i++) {
+        ddr_stats_sum(ddr_pick_phase, i, &sum);
+        ddr_stats_show_one(m, "phase", ddr_phase_names[i], &sum);
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ddr_stats);
+
+static int ddr_stats_enable_get(void *data, u64 *val)
+{
+    *val = static_key_enabled(&ddr_stats_on);
+    return 0;
+}
+
+static int ddr_stats_enable_set(void *data, u64 val)
+{
+    if (val)
+        static_branch_enable(&ddr_stats_on);
+    else
+        static_branch_disable(&ddr_stats_on);
+    return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(ddr_stats_enable_fops, ddr_stats_enable_get, ddr_stats_enable_set,
+                         "%llu\n");
+
+/* Any write clears every counter; updates racing with it may survive. */
+static int ddr_stats_reset_set(void *data, u64 val)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(ddr_stats, cpu), 0, sizeof(struct ddr_stats));
+    return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(ddr_stats_reset_fops, NULL, ddr_stats_reset_set, "%llu\n");
+
+static void ddr_debugfs_init(void)
+{
+    ddr_debugfs = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file_unsafe("enable", 0600, ddr_debugfs, NULL, &ddr_stats_enable_fops);
+    debugfs_create_file_unsafe("reset", 0200, ddr_debugfs, NULL, &ddr_stats_reset_fops);
+    debugfs_create_file("stats", 0400, ddr_debugfs, NULL, &ddr_stats_fops);
+}
+
+/*
+ * Cache of ioremap windows keyed by window-aligned physical address.
+ * Most recently used windows sit at the head of ddr_map_lru; idle
+ * windows are evicted from the tail once more than map_cache_size are
+ * mapped. A window in use (users > 0) is never unmapped.
+ */
+struct ddr_map {
+    struct list_head lru;
+    unsigned long base;
+    void __iomem *vaddr;
+    unsigned int users;
+};
+
+static LIST_HEAD(ddr_map_lru);
+static DEFINE_MUTEX(ddr_map_lock);
+static unsigned int ddr_map_count;
+static unsigned long ddr_map_hits;
+static unsigned long ddr_map_misses;
+static unsigned long ddr_map_evictions;
+
+/*
+ * The write-once check and the write that follows must not be split by
+ * another writer. Writers take ddr_region_sem shared and then lock every
+ * bucket their range touches, in ascending bucket order, so disjoint
+ * ranges usually proceed in parallel while overlapping ones serialise.
+ * A range over DDR_LOCK_MAX_PAGES pages (a large SG write, DDR_MEMTEST)
+ * takes ddr_region_sem exclusive instead of piling up bucket locks. The
+ * buckets are mutexes rather than spinlocks because the map cache may
+ * ioremap() inside the section, and each has its own lockdep class; at
+ * most DDR_LOCK_MAX_PAGES of them are ever held together, well inside
+ * lockdep's MAX_LOCK_DEPTH.
+ */
+static DECLARE_RWSEM(ddr_region_sem);
+static struct mutex ddr_region_locks[DDR_LOCK_BUCKETS];
+static struct lock_class_key ddr_region_keys[DDR_LOCK_BUCKETS];
+
+/* Locks taken by ddr_lock_range(), for ddr_unlock_range(). */
+struct ddr_held {
+    DECLARE_BITMAP(buckets, DDR_LOCK_BUCKETS);
+    bool all;
+};
+
+/* Unmap idle windows from the LRU tail until we are back within budget. Caller holds ddr_map_lock. */
+static void ddr_map_trim(void)
+{
+    struct ddr_map *map, *tmp;
+
+    list_for_each_entry_safe_reverse(map, tmp, &ddr_map_lru, lru) {
+        if (ddr_map_count <= map_cache_size)
+            break;
+        if (map->users)
+            continue;
+        list_del(&map->lru);
+        ddr_be->unmap(map->vaddr);
+        kfree(map);
+        ddr_map_count--;
+        ddr_map_evictions++;
+    }
+}
+
+static struct ddr_map *ddr_map_get(unsigned long addr)
+{
+    unsigned long base = addr & ~((unsigned long)map_window_size - 1);
+    u64 t = ddr_stat_start();
+    struct ddr_map *map;
+
+    mutex_lock(&ddr_map_lock);
+    list_for_each_entry(map, &ddr_map_lru, lru) {
+        if (map->base == base) {
+            list_move(&map->lru, &ddr_map_lru);
+            map->users++;
+            ddr_map_hits++;
+            mutex_unlock(&ddr_map_lock);
+            ddr_stat_phase(DDR_PHASE_MAP, t);
+            return map;
+        }
+    }
+
+    ddr_map_misses++;
+    map = kzalloc(sizeof(*map), GFP_KERNEL);
+    if (!map)
+        goto out;
+
+    map->vaddr = ddr_be->map(base, map_window_size);
+    if (!map->vaddr) {
+        kfree(map);
+        map = NULL;
+        goto out;
+    }
+    map->base = base;
+    map->users = 1;
+    list_add(&map->lru, &ddr_map_lru);
+    ddr_map_count++;
+    ddr_map_trim();
+out:
+    mutex_unlock(&ddr_map_lock);
+    ddr_stat_phase(DDR_PHASE_MAP, t);
+    return map;
+}
+
+static void ddr_map_put(struct ddr_map *map)
+{
+    mutex_lock(&ddr_map_lock);
+    map->users--;
+    ddr_map_trim();
+    mutex_unlock(&ddr_map_lock);
+}
+
+/*
+ * Return the kernel address of the word at @addr, reusing the window in
+ * *@map when it covers @addr. Release the final window with ddr_map_put().
+ */
+static void __iomem *ddr_map_word(unsigned long addr, struct ddr_map **map)
+{
+    if (*map && addr - (*map)->base < map_window_size)
+        return (*map)->vaddr + (addr - (*map)->base);
+
+    if (*map)
+        ddr_map_put(*map);
+    *map = ddr_map_get(addr);
+    if (!*map)
+        return NULL;
+
+    return (*map)->vaddr + (addr - (*map)->base);
+}
+
+static void ddr_map_flush(void)
+{
+    struct ddr_map *map, *tmp;
+
+    mutex_lock(&ddr_map_lock);
+    list_for_each_entry_safe(map, tmp, &ddr_map_lru, lru) {
+        list_del(&map->lru);
+        ddr_be->unmap(map->vaddr);
+        kfree(map);
+    }
+    ddr_map_count = 0;
+    mutex_unlock(&ddr_map_lock);
+}
+
+static ssize_t map_cache_stats_show(struct device *dev,
+                                    struct device_attribute *attr, char *buf)
+{
+    ssize_t len;
+
+    mutex_lock(&ddr_map_lock);
+    len = sysfs_emit(buf, "hits %lu\nmisses %lu\nevictions %lu\nmapped %u\n",
+                     ddr_map_hits, ddr_map_misses, ddr_map_evictions,
+                     ddr_map_count);
+    mutex_unlock(&ddr_map_lock);
+    return len;
+}
+
+static ssize_t map_cache_stats_store(struct device *dev,
+                                     struct device_attribute *attr,
+                                     const char *buf, size_t count)
+{
+    // any write resets the counters
+    mutex_lock(&ddr_map_lock);
+    ddr_map_hits = 0;
+    ddr_map_misses = 0;
+    ddr_map_evictions = 0;
+    mutex_unlock(&ddr_map_lock);
+    return count;
+}
+static DEVICE_ATTR_RW(map_cache_stats);
+
+static struct attribute *ddr_attrs[] = {
+    &dev_attr_map_cache_stats.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(ddr);
+
+static void ddr_lock_range(unsigned long addr, size_t len, struct ddr_held *held)
+{
+    unsigned long pfn = addr >> PAGE_SHIFT;
+    unsigned long last = (addr + len - 1) >> PAGE_SHIFT;
+    u64 t = ddr_stat_start();
+    unsigned int b;
+
+    bitmap_zero(held->buckets, DDR_LOCK_BUCKETS);
+    held->all = last - pfn >= DDR_LOCK_MAX_PAGES;
+    if (held->all) {
+        down_write(&ddr_region_sem);
+        ddr_stat_phase(DDR_PHASE_LOCK, t);
+        return;
+    }
+
+    for (; pfn <= last; pfn++)
+        __set_bit(hash_long(pfn, DDR_LOCK_BITS), held->buckets);
+    down_read(&ddr_region_sem);
+    for_each_set_bit(b, held->buckets, DDR_LOCK_BUCKETS)
+        mutex_lock(&ddr_region_locks[b]);
+    ddr_stat_phase(DDR_PHASE_LOCK, t);
+}
+
+static void ddr_unlock_range(struct ddr_held *held)
+{
+    unsigned int b;
+
+    if (held->all) {
+        up_write(&ddr_region_sem);
+        return;
+    }
+    for_each_set_bit(b, held->buckets, DDR_LOCK_BUCKETS)
+        mutex_unlock(&ddr_region_locks[b]);
+    up_read(&ddr_region_sem);
+}
+
+static int ddr_read_words(unsigned long addr, u32 *vals, size_t count)
+{
+    struct ddr_map *map = NULL;
+    void __iomem *vaddr;
+    u64 t = ddr_stat_start();
+    size_t i;
+    int ret = 0;
+
+    for (i = 0; i < count; i++) {
+        vaddr = ddr_map_word(addr + i * 4, &map);
+        if (!vaddr) {
+            ret = -ENOMEM;
+            break;
+        }
+
+        vals[i] = ddr_read32(vaddr);
+        trace_ddr_word(addr + i * 4, vals[i], false, true);
+    }
+    if (map)
+        ddr_map_put(map);
+    ddr_stat_phase(DDR_PHASE_ACCESS, t);
+    return ret;
+}
+
+static int ddr_write_words(unsigned long addr, const u32 *vals, size_t count)
+{
+    struct ddr_held held;
+    struct ddr_map *map = NULL;
+    void __iomem *vaddr;
+    bool empty;
+    size_t i;
+    u64 t;
+    int ret = 0;
+
+    if (!count)
+        return 0;
+
+    ddr_lock_range(addr, count * 4, &held);
+    t = ddr_stat_start();
+    for (i = 0; i < count; i++) {
+        vaddr = ddr_map_word(addr + i * 4, &map);
+        if (!vaddr) {
+            ret = -ENOMEM;
+            break;
+        }
+
+        // write only if empty (0)
+        empty = ddr_read32(vaddr) == 0;
+        if (empty)
+            ddr_write32(vals[i], vaddr);
+        trace_ddr_word(addr + i * 4, vals[i], true, empty);
+    }
+    ddr_stat_phase(DDR_PHASE_ACCESS, t);
+    ddr_unlock_range(&held);
+
+    if (map)
+        ddr_map_put(map);
+    return ret;
+}
+
+/* Element @i of a packed array of @width-byte values. */
+static u64 ddr_elem_get(const void *buf, unsigned int width, size_t i)
+{
+    switch (width) {
+    case 1:
+        return ((const u8 *)buf)[i];
+    case 2:
+        return ((const u16 *)buf)[i];
+    case 8:
+        return ((const u64 *)buf)[i];
+    default:
+        return ((const u32 *)buf)[i];
+    }
+}
+
+static void ddr_elem_set(void *buf, unsigned int width, size_t i, u64 value)
+{
+    switch (width) {
+    case 1:
+        ((u8 *)buf)[i] = value;
+        break;
+    case 2:
+        ((u16 *)buf)[i] = value;
+        break;
+    case 8:
+        ((u64 *)buf)[i] = value;
+        break;
+    default:
+        ((u32 *)buf)[i] = value;
+    }
+}
+
+/*
+ * Width-aware versions of ddr_read_words/ddr_write_words: @buf holds
+ * @count packed @width-byte values and every element is one bus access,
+ * so 64-bit registers are never torn. Width 4 takes the word paths.
+ */
+static int ddr_read_elems(unsigned long addr, unsigned int width, void *buf, size_t count)
+{
+    struct ddr_map *map = NULL;
+    void __iomem *vaddr;
+    u64 t, value;
+    size_t i;
+    int ret = 0;
+
+    if (width == 4)
+        return ddr_read_words(addr, buf, count);
+
+    t = ddr_stat_start();
+    for (i = 0; i < count; i++) {
+        vaddr = ddr_map_word(addr + i * width, &map);
+        if (!vaddr) {
+            ret = -ENOMEM;
+            break;
+        }
+
+        value = ddr_be->read(vaddr, width);
+        ddr_elem_set(buf, width, i, value);
+        trace_ddr_word(addr + i * width, value, false, true);
+    }
+    if (map)
+        ddr_map_put(map);
+    ddr_stat_phase(DDR_PHASE_ACCESS, t);
+    return ret;
+}
+
+static int ddr_write_elems(unsigned long addr, unsigned int width, const void *buf,
+                           size_t count)
+{
+    struct ddr_held held;
+    struct ddr_map *map = NULL;
+    void __iomem *vaddr;
+    u64 t, value;
+    bool empty;
+    size_t i;
+    int ret = 0;
+
+    if (width == 4)
+        return ddr_write_words(addr, buf, count);
+    if (!count)
+        return 0;
+
+    ddr_lock_range(addr, count * width, &held);
+    t = ddr_stat_start();
+    for (i = 0; i < count; i++) {
+        vaddr = ddr_map_word(addr + i * width, &map);
+        if (!vaddr) {
+            ret = -ENOMEM;
+            break;
+        }
+
+        // same write-once rule, applied to the whole element
+        value = ddr_elem_get(buf, width, i);
+        empty = ddr_be->read(vaddr, width) == 0;
+        if (empty)
+            ddr_be->write(value, vaddr, width);
+        trace_ddr_word(addr + i * width, value, true, empty);
+    }
+    ddr_stat_phase(DDR_PHASE_ACCESS, t);
+    ddr_unlock_range(&held);
+
+    if (map)
+        ddr_map_put(map);
+    return ret;
+}
+
+/* Stream one segment of @width-byte elements between DDR and user memory through the bounce buffer. */
+static int ddr_xfer_seg(u64 addr, unsigned int width, u64 count, void __user *ubuf,
+                        void *bounce, bool write)
+{
+    u64 end, t;
+    size_t n;
+    int ret;
+
+    if (addr % width != 0)
+        return -EINVAL;
+    if (!count)
+        return 0;
+    if (check_mul_overflow(count, (u64)width, &end) || check_add_overflow(addr, end, &end) ||
+        end - 1 > ULONG_MAX)
+        return -EINVAL;
+
+    while (count) {
+        n = min_t(u64, count, PAGE_SIZE / width);
+        t = ddr_trace_start();
+
+        if (write) {
+            if (ddr_copy_from_user(bounce, ubuf, n * width))
+                return -EFAULT;
+            ret = ddr_write_elems(addr, width, bounce, n);
+        } else {
+            ret = ddr_read_elems(addr, width, bounce, n);
+            if (!ret && ddr_copy_to_user(ubuf, bounce, n * width))
+                ret = -EFAULT;
+        }
+        trace_ddr_op(write ? DDR_TR_WRITE_SG : DDR_TR_READ_SG, addr,
+                     ddr_elem_get(bounce, width, 0), n, width, ret, t);
+        if (ret)
+            return ret;
+
+        addr += n * width;
+        ubuf += n * width;
+        count -= n;
+
+        if (fatal_signal_pending(current))
+            return -EINTR;
+        cond_resched();
+    }
+    return 0;
+}
+
+static int ddr_xfer(unsigned long arg, bool write)
+{
+    struct ddr_xfer_args args;
+    struct ddr_seg __user *usegs;
+    struct ddr_seg seg;
+    u32 __user *ubuf;
+    u32 *bounce;
+    u32 i;
+    int ret = 0;
+
+    if (ddr_copy_from_user(&args, (void __user *)arg, sizeof(args)))
+        return -EFAULT;
+
+    if (args.flags)
+        return -EINVAL;
+
+    bounce = kmalloc(DDR_BOUNCE_WORDS * sizeof(u32), GFP_KERNEL);
+    if (!bounce)
+        return -ENOMEM;
+
+    ubuf = u64_to_user_ptr(args.buf);
+    if (!args.nsegs) {
+        ret = ddr_xfer_seg(args.addr, 4, args.count, ubuf, bounce, write);
+        goto out;
+    }
+
+    usegs = u64_to_user_ptr(args.segs);
+    for (i = 0; i < args.nsegs; i++) {
+        if (ddr_copy_from_user(&seg, &usegs[i], sizeof(seg))) {
+            ret = -EFAULT;
+            break;
+        }
+        ret = ddr_xfer_seg(seg.addr, 4, seg.count, ubuf, bounce, write);
+        if (ret)
+            break;
+        ubuf += seg.count;
+    }
+out:
+    kfree(bounce);
+    return ret;
+}
+
+/*
+ * readx_poll_timeout() with adaptive backoff: the first reads are back to
+ * back, then the gap doubles up to interval_us. Gaps under
+ * DDR_POLL_SPIN_US are busy-waited, longer ones sleep. An interval_us of
+ * 0 spins for DDR_POLL_MAX_SPIN_US only, then backs off to
+ * DDR_POLL_IDLE_US, so a long timeout cannot pin a CPU. One last read is
+ * made after the deadline so a sleep that overshoots cannot miss the
+ * condition.
+ */
+static int ddr_poll_word(void __iomem *vaddr, u32 mask, u32 expected, u32 timeout_us,
+                         u32 interval_us, u32 *val, u64 *elapsed_ns)
+{
+    ktime_t start = ktime_get();
+    ktime_t deadline = ktime_add_us(start, timeout_us);
+    ktime_t now;
+    u32 delay = 0;
+    int ret;
+
+    for (;;) {
+        now = ktime_get();
+        *val = ddr_read32(vaddr);
+        if ((*val & mask) == expected) {
+            ret = 0;
+            break;
+        }
+        if (ktime_after(now, deadline)) {
+            *val = ddr_read32(vaddr);
+            ret = (*val & mask) == expected ? 0 : -ETIMEDOUT;
+            break;
+        }
+        if (signal_pending(current)) {
+            ret = -EINTR;
+            break;
+        }
+
+        if (!delay) {
+            cpu_relax();
+            cond_resched();
+        } else if (delay < DDR_POLL_SPIN_US) {
+            udelay(delay);
+            cond_resched();
+        } else {
+            usleep_range(delay, delay + delay / 4);
+        }
+        if (!interval_us && ktime_us_delta(now, start) > DDR_POLL_MAX_SPIN_US)
+            interval_us = DDR_POLL_IDLE_US;
+        delay = min(delay ? delay * 2 : 1, interval_us);
+    }
+
+    *elapsed_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+    return ret;
+}
+
+static int ddr_poll(unsigned long arg)
+{
+    struct ddr_poll_args __user *uargs = (void __user *)arg;
+    struct ddr_poll_args args;
+    struct ddr_map *map = NULL;
+    void __iomem *vaddr;
+    int ret;
+    u64 t;
+
+    if (ddr_copy_from_user(&args, uargs, sizeof(args)))
+        return -EFAULT;
+
+    if (args.addr % 4 != 0 || args.addr > ULONG_MAX - 3)
+        return -EINVAL;
+
+    // a condition that is always or never true is a caller bug
+    if (!args.mask || (args.expected & ~args.mask))
+        return -EINVAL;
+
+    vaddr = ddr_map_word(args.addr, &map);
+    if (!vaddr)
+        return -ENOMEM;
+
+    t = ddr_trace_start();
+    ret = ddr_poll_word(vaddr, args.mask, args.expected, args.timeout_us,
+                        args.interval_us, &args.value, &args.elapsed_ns);
+    trace_ddr_op(DDR_TR_POLL, args.addr, args.value, 1, 4, ret, t);
+    ddr_map_put(map);
+
+    if (ret && ret != -ETIMEDOUT)
+        return ret;
+    if (ddr_copy_to_user(uargs, &args, sizeof(args)))
+        return -EFAULT;
+    return ret;
+}
+
+static int ddr_batch_one(struct ddr_batch_op *op, struct ddr_map **map)
+{
+    struct ddr_held held;
+    void __iomem *vaddr;
+    u64 elapsed;
+    int ret = 0;
+
+    if (op->addr % 4 != 0 || op->addr > ULONG_MAX - 3)
+        return -EINVAL;
+
+    // same condition checks as DDR_POLL
+    if (op->op == DDR_OP_POLL && (!op->mask || (op->value & ~op->mask)))
+        return -EINVAL;
+
+    vaddr = ddr_map_word(op->addr, map);
+    if (!vaddr)
+        return -ENOMEM;
+
+    switch (op->op) {
+    case DDR_OP_READ:
+        op->value = ddr_read32(vaddr);
+        return 0;
+    case DDR_OP_WRITE:
+        ddr_lock_range(op->addr, 4, &held);
+        if (ddr_read32(vaddr) != 0)
+            ret = -EEXIST;
+        else
+            ddr_write32(op->value, vaddr);
+        ddr_unlock_range(&held);
+        return ret;
+    case DDR_OP_CLEAR:
+        ddr_lock_range(op->addr, 4, &held);
+        ddr_write32(0, vaddr);
+        ddr_unlock_range(&held);
+        return 0;
+    case DDR_OP_POLL:
+        return ddr_poll_word(vaddr, op->mask, op->value, poll_timeout_us,
+                             poll_interval_us, &op->value, &elapsed);
+    default:
+        return -EINVAL;
+    }
+}
+
+static int ddr_batch(unsigned long arg)
+{
+    struct ddr_batch_args __user *uargs = (void __user *)arg;
+    struct ddr_batch_args args;
+    struct ddr_batch_op *ops;
+    struct ddr_batch_op __user *uops;
+    struct ddr_map *map = NULL;
+    u32 done = 0, n, i;
+    int ret = 0;
+    u64 t;
+
+    if (ddr_copy_from_user(&args, uargs, sizeof(args)))
+        return -EFAULT;
+
+    ops = kmalloc_array(DDR_BATCH_CHUNK, sizeof(*ops), GFP_KERNEL);
+    if (!ops)
+        return -ENOMEM;
+
+    uops = u64_to_user_ptr(args.ops);
+    args.failed = -1;
+    while (done < args.count && args.failed < 0) {
+        n = min_t(u32, args.count - done, DDR_BATCH_CHUNK);
+        if (ddr_copy_from_user(ops, uops + done, n * sizeof(*ops))) {
+            ret = -EFAULT;
+            goto out;
+        }
+
+        for (i = 0; i < n; i++) {
+            t = ddr_trace_start();
+            ops[i].result = ddr_batch_one(&ops[i], &map);
+            // an unknown opcode has no trace type of its own
+            if (ops[i].op <= DDR_OP_POLL)
+                trace_ddr_op(DDR_TR_BATCH_READ + ops[i].op, ops[i].addr, ops[i].value, 1, 4,
+                             ops[i].result, t);
+            if (ops[i].result) {
+                args.failed = done + i;
+                n = i + 1;
+                break;
+            }
+        }
+
+        if (ddr_copy_to_user(uops + done, ops, n * sizeof(*ops))) {
+            ret = -EFAULT;
+            goto out;
+        }
+        done += n;
+    }
+
+    if (ddr_copy_to_user(uargs, &args, sizeof(args)))
+        ret = -EFAULT;
+out:
+    if (map)
+        ddr_map_put(map);
+    kfree(ops);
+    return ret;
+}
+
+/*
+ * Per-open state. A watchlist keeps its windows mapped for as long as
+ * it is armed, so the sampling timer only does ddr_read32() and never
+ * touches the map cache. The timer is the only producer of the event
+ * fifo and read() (under lock) the only consumer.
+ */
+struct ddr_watch {
+    unsigned long addr;
+    u32 mask;
+    u32 last;
+    void __iomem *vaddr;
+    struct ddr_map *map;
+};
+
+/*
+ * High-rate sampler behind /dev/ddr_sample. The ring is shared with user
+ * space, so the producer keeps its own copies of everything it indexes
+ * with and only reads the consumer's tail from the mapping.
+ */
+struct ddr_sampler {
+    struct ddr_sample_ring *ring;
+    size_t size;
+    atomic_t maps;              // live user mappings of ring
+    u32 slots;
+    u32 slot_size;
+    u32 head;
+    u64 overruns;
+    u64 missed;
+    u32 nregs;
+    void __iomem *vaddr[DDR_SAMPLE_MAX_REGS];
+    struct ddr_map *map[DDR_SAMPLE_MAX_REGS];
+    ktime_t period;
+    struct hrtimer timer;
+    struct task_struct *thread;
+};
+
+struct ddr_client {
+    struct mutex lock;          // watch/sampler setup and read()
+    struct hrtimer timer;
+    ktime_t period;
+    struct ddr_watch *watch;
+    u32 nwatch;
+    u32 dropped;                // events lost since the last one queued
+    DECLARE_KFIFO(events, struct ddr_watch_event, DDR_WATCH_FIFO);
+    wait_queue_head_t wait;
+    struct eventfd_ctx *efd;
+    bool sample_node;
+    struct ddr_sampler sample;
+};
+
+static enum hrtimer_restart ddr_watch_sample(struct hrtimer *timer)
+{
+    struct ddr_client *c = container_of(timer, struct ddr_client, timer);
+    struct ddr_watch_event ev;
+    u64 now = ktime_get_ns();
+    bool changed = false;
+    u32 i, v;
+
+    for (i = 0; i < c->nwatch; i++) {
+        struct ddr_watch *w = &c->watch[i];
+
+        v = ddr_read32(w->vaddr);
+        if (!((v ^ w->last) & w->mask))
+            continue;
+
+        ev.timestamp_ns = now;
+        ev.addr = w->addr;
+        ev.index = i;
+        ev.old_value = w->last;
+        ev.new_value = v;
+        ev.dropped = c->dropped;
+        w->last = v;
+        if (kfifo_put(&c->events, ev))
+            c->dropped = 0;
+        else
+            c->dropped++;
+        changed = true;
+    }
+
+    if (changed) {
+        wake_up_interruptible(&c->wait);
+        if (c->efd)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,8,0)
+            eventfd_signal(c->efd);
+#else
+            eventfd_signal(c->efd, 1);
+#endif
+    }
+
+    hrtimer_forward_now(timer, c->period);
+    return HRTIMER_RESTART;
+}
+
+/* Disarm and free the current watchlist. Caller holds c->lock. */
+static void ddr_watch_stop(struct ddr_client *c)
+{
+    u32 i;
+
+    hrtimer_cancel(&c->timer);
+    for (i = 0; i < c->nwatch; i++)
+        ddr_map_put(c->watch[i].map);
+    kfree(c->watch);
+    c->watch = NULL;
+    WRITE_ONCE(c->nwatch, 0);
+    if (c->efd) {
+        eventfd_ctx_put(c->efd);
+        c->efd = NULL;
+    }
+}
+
+static int ddr_watch_set(struct ddr_client *c, unsigned long arg)
+{
+    struct ddr_watch_args args;
+    struct ddr_watch_entry *ents = NULL;
+    struct ddr_watch *w = NULL;
+    struct eventfd_ctx *efd = NULL;
+    u32 i = 0;
+    int ret;
+
+    if (ddr_copy_from_user(&args, (void __user *)arg, sizeof(args)))
+        return -EFAULT;
+
+    if (args.flags || args.count > DDR_WATCH_MAX)
+        return -EINVAL;
+    if (args.count && args.period_us < DDR_WATCH_MIN_PERIOD_US)
+        return -EINVAL;
+
+    if (args.count) {
+        ents = kmalloc_array(args.count, sizeof(*ents), GFP_KERNEL);
+        w = kcalloc(args.count, sizeof(*w), GFP_KERNEL);
+        if (!ents || !w) {
+            ret = -ENOMEM;
+            goto err;
+        }
+        if (ddr_copy_from_user(ents, u64_to_user_ptr(args.entries), args.count * sizeof(*ents))) {
+            ret = -EFAULT;
+            goto err;
+        }
+
+        for (i = 0; i < args.count; i++) {
+            if (ents[i].addr % 4 != 0 || ents[i].addr > ULONG_MAX - 3 || !ents[i].mask) {
+                ret = -EINVAL;
+                goto err;
+            }
+            w[i].map = ddr_map_get(ents[i].addr);
+            if (!w[i].map) {
+                ret = -ENOMEM;
+                goto err;
+            }
+            w[i].addr = ents[i].addr;
+            w[i].mask = ents[i].mask;
+            w[i].vaddr = w[i].map->vaddr + (w[i].addr - w[i].map->base);
+            w[i].last = ddr_read32(w[i].vaddr);
+        }
+
+        if (args.eventfd >= 0) {
+            efd = eventfd_ctx_fdget(args.eventfd);
+            if (IS_ERR(efd)) {
+                ret = PTR_ERR(efd);
+                efd = NULL;
+                goto err;
+            }
+        }
+    }
+    kfree(ents);
+
+    mutex_lock(&c->lock);
+    ddr_watch_stop(c);
+    kfifo_reset(&c->events);
+    c->watch = w;
+    c->efd = efd;
+    c->dropped = 0;
+    WRITE_ONCE(c->nwatch, args.count);
+    if (args.count) {
+        c->period = us_to_ktime(args.period_us);
+        hrtimer_start(&c->timer, c->period, HRTIMER_MODE_REL_SOFT);
+    }
+    mutex_unlock(&c->lock);
+
+    // readers blocked on a watch that was just cleared see end of file
+    wake_up_interruptible(&c->wait);
+    return 0;
+
+err:
+    while (i--)
+        ddr_map_put(w[i].map);
+    kfree(w);
+    kfree(ents);
+    return ret;
+}
+
+static void ddr_sample_once(struct ddr_sampler *s)
+{
+    struct ddr_sample *slot;
+    u32 i;
+
+    // reader a whole ring behind: drop the new sample, keep the old ones
+    if (s->head - smp_load_acquire(&s->ring->tail) >= s->slots) {
+        s->overruns++;
+        WRITE_ONCE(s->ring->overruns, s->overruns);
+        return;
+    }
+
+    slot = (void *)s->ring + PAGE_SIZE + (size_t)(s->head & (s->slots - 1)) * s->slot_size;
+    slot->timestamp_ns = ktime_get_ns();
+    for (i = 0; i < s->nregs; i++)
+        slot->values[i] = ddr_read32(s->vaddr[i]);
+    s->head++;
+    smp_store_release(&s->ring->head, s->head);
+}
+
+static enum hrtimer_restart ddr_sample_tick(struct hrtimer *timer)
+{
+    struct ddr_sampler *s = container_of(timer, struct ddr_sampler, timer);
+    u64 periods = hrtimer_forward_now(timer, s->period);
+
+    if (periods > 1) {
+        s->missed += periods - 1;
+        WRITE_ONCE(s->ring->missed, s->missed);
+    }
+    ddr_sample_once(s);
+    return HRTIMER_RESTART;
+}
+
+/* Pinned busy-wait loop for rates where timer interrupt jitter is too high. */
+static int ddr_sample_thread(void *data)
+{
+    struct ddr_sampler *s = data;
+    s64 period_ns = ktime_to_ns(s->period);
+    ktime_t next = ktime_get();
+    ktime_t now;
+    u64 behind;
+
+    while (!kthread_should_stop()) {
+        ddr_sample_once(s);
+
+        next = ktime_add_ns(next, period_ns);
+        now = ktime_get();
+        if (ktime_after(now, next)) {
+            behind = div64_u64(ktime_to_ns(ktime_sub(now, next)), period_ns) + 1;
+            s->missed += behind;
+            WRITE_ONCE(s->ring->missed, s->missed);
+            next = ktime_add_ns(next, behind * period_ns);
+        }
+        while (ktime_before(ktime_get(), next) && !kthread_should_stop())
+            cpu_relax();
+        cond_resched();
+    }
+    return 0;
+}
+
+/* Stop sampling and drop the register mappings; the ring stays. Caller holds c->lock. */
+static void ddr_sample_stop(struct ddr_sampler *s)
+{
+    u32 i;
+
+    if (s->thread) {
+        kthread_stop(s->thread);
+        s->thread = NULL;
+    } else if (s->nregs) {
+        hrtimer_cancel(&s->timer);
+    }
+    for (i = 0; i < s->nregs; i++)
+        ddr_map_put(s->map[i]);
+    s->nregs = 0;
+}
 
-#define DEVICE_NAME "ddr"
-#define CLASS_NAME  "ddr_class"
+static int ddr_sample_set(struct ddr_client *c, unsigned long arg)
+{
+    struct ddr_sample_args __user *uargs = (void __user *)arg;
+    struct ddr_sampler *s = &c->sample;
+    struct ddr_sample_args args;
+    u64 addrs[DDR_SAMPLE_MAX_REGS];
+    size_t size;
+    u32 slot_size, i;
+    int ret = 0;
 
-// IOCTL magic + commands
-#define DDR_IOC_MAGIC  'k'
-#define DDR_READ       _IOWR(DDR_IOC_MAGIC, 1, struct ddr_rw_args)
-#define DDR_WRITE      _IOW(DDR_IOC_MAGIC,  2, struct ddr_rw_args)
-#define DDR_READ_RANGE _IOWR(DDR_IOC_MAGIC, 3, struct ddr_range_args)
-#define DDR_WRITE_RANGE _IOW(DDR_IOC_MAGIC, 4, struct ddr_range_args)
+    if (!c->sample_node)
+        return -EINVAL;
 
-MODULE_LICENSE("GPL");
-MODULE_AUTHOR("Pranesh");
-MODULE_DESCRIPTION("DDR register read/write kernel module with word alignment and overwrite protection");
-MODULE_VERSION("1.0");
+    if (ddr_copy_from_user(&args, uargs, sizeof(args)))
+        return -EFAULT;
 
-static int ddr_major;
-static struct class *ddr_class;
-static struct device *ddr_device;
+    if (args.nregs > DDR_SAMPLE_MAX_REGS)
+        return -EINVAL;
+    if (args.nregs && (args.period_ns < DDR_SAMPLE_MIN_PERIOD_NS ||
+                       !is_power_of_2(args.slots) || args.slots > DDR_SAMPLE_MAX_SLOTS ||
+                       (args.cpu >= 0 && ((u32)args.cpu >= nr_cpu_ids || !cpu_online(args.cpu))) ||
+                       args.cpu < -1))
+        return -EINVAL;
+    if (ddr_copy_from_user(addrs, u64_to_user_ptr(args.addrs), args.nregs * sizeof(u64)))
+        return -EFAULT;
+    for (i = 0; i < args.nregs; i++)
+        if (addrs[i] % 4 != 0 || addrs[i] > ULONG_MAX - 3)
+            return -EINVAL;
 
-struct ddr_rw_args {
-    unsigned long addr;
-    u32 value;
+    mutex_lock(&c->lock);
+    ddr_sample_stop(s);
+    if (!args.nregs)
+        goto out;
+
+    // a fresh ring for every run; the old one must not be mapped any more
+    if (s->ring && atomic_read(&s->maps)) {
+        ret = -EBUSY;
+        goto out;
+    }
+    vfree(s->ring);
+    s->ring = NULL;
+
+    slot_size = ALIGN(sizeof(struct ddr_sample) + args.nregs * sizeof(u32), 8);
+    size = PAGE_SIZE + PAGE_ALIGN((size_t)args.slots * slot_size);
+    s->ring = vmalloc_user(size);
+    if (!s->ring) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    s->size = size;
+    s->slots = args.slots;
+    s->slot_size = slot_size;
+    s->head = 0;
+    s->overruns = 0;
+    s->missed = 0;
+    s->ring->slots = args.slots;
+    s->ring->slot_size = slot_size;
+    s->ring->nregs = args.nregs;
+    s->ring->period_ns = args.period_ns;
+    s->ring->data_offset = PAGE_SIZE;
+
+    for (i = 0; i < args.nregs; i++) {
+        s->map[i] = ddr_map_get(addrs[i]);
+        if (!s->map[i]) {
+            while (i--)
+                ddr_map_put(s->map[i]);
+            ret = -ENOMEM;
+            goto out;
+        }
+        s->vaddr[i] = s->map[i]->vaddr + (addrs[i] - s->map[i]->base);
+    }
+    s->nregs = args.nregs;
+    s->period = ns_to_ktime(args.period_ns);
+
+    if (args.cpu >= 0) {
+        s->thread = kthread_create(ddr_sample_thread, s, "ddr_sample/%d", args.cpu);
+        if (IS_ERR(s->thread)) {
+            ret = PTR_ERR(s->thread);
+            s->thread = NULL;
+            s->nregs = 0;
+            for (i = 0; i < args.nregs; i++)
+                ddr_map_put(s->map[i]);
+            goto out;
+        }
+        kthread_bind(s->thread, args.cpu);
+        wake_up_process(s->thread);
+    } else {
+        hrtimer_start(&s->timer, s->period, HRTIMER_MODE_REL_PINNED_HARD);
+    }
+
+    args.ring_size = size;
+    if (ddr_copy_to_user(uargs, &args, sizeof(args)))
+        ret = -EFAULT;
+out:
+    mutex_unlock(&c->lock);
+    return ret;
+}
+
+static void ddr_sample_vm_open(struct vm_area_struct *vma)
+{
+    struct ddr_client *c = vma->vm_private_data;
+
+    atomic_inc(&c->sample.maps);
+}
+
+static void ddr_sample_vm_close(struct vm_area_struct *vma)
+{
+    struct ddr_client *c = vma->vm_private_data;
+
+    atomic_dec(&c->sample.maps);
+}
+
+static const struct vm_operations_struct ddr_sample_vm_ops = {
+    .open  = ddr_sample_vm_open,
+    .close = ddr_sample_vm_close,
 };
 
-struct ddr_range_args {
-    unsigned long addr;
-    u32 values[256];
-    int count;
+static int ddr_sample_mmap(struct ddr_client *c, struct vm_area_struct *vma)
+{
+    struct ddr_sampler *s = &c->sample;
+    int ret;
+
+    mutex_lock(&c->lock);
+    if (!s->ring) {
+        ret = -ENODEV;
+        goto out;
+    }
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start > s->size) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    ret = remap_vmalloc_range(vma, s->ring, 0);
+    if (ret)
+        goto out;
+    vma->vm_private_data = c;
+    vma->vm_ops = &ddr_sample_vm_ops;
+    atomic_inc(&s->maps);
+out:
+    mutex_unlock(&c->lock);
+    return ret;
+}
+
+/*
+ * DDR_MEMTEST. The range is split into page-aligned chunks, each mapped
+ * on its own and tested by a work item on system_unbound_wq, so chunks
+ * run on different CPUs. Patterns run per chunk: March C- finds coupling
+ * faults within a chunk but not across chunk boundaries. Writers to the
+ * range are held off through the region locks for the whole test; past
+ * DDR_LOCK_MAX_PAGES pages that means every writer.
+ */
+#define DDR_MT_WIDTH       (IS_ENABLED(CONFIG_64BIT) ? 8 : 4)
+#define DDR_MT_MASK        (DDR_MT_WIDTH == 8 ? ~0ULL : 0xffffffffULL)
+#define DDR_MT_MAX_THREADS 64
+#define DDR_MT_YIELD       4096    // elements between abort checks
+
+struct ddr_mt_job {
+    const struct ddr_memtest_args *args;
+    atomic_t pending;
+    struct completion done;
+    bool abort;
 };
 
-static long ddr_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+struct ddr_mt_chunk {
+    struct work_struct work;
+    struct ddr_mt_job *job;
+    unsigned long base;
+    size_t n;                   // elements
+    void __iomem *vaddr;
+    u64 errors;
+    u64 bytes;
+    u32 nfails;
+    int ret;
+    struct ddr_memtest_fail fails[DDR_MEMTEST_MAX_FAILS];
+};
+
+static inline void ddr_mt_write(struct ddr_mt_chunk *c, size_t i, u64 value)
+{
+    ddr_be->write(value, c->vaddr + i * DDR_MT_WIDTH, DDR_MT_WIDTH);
+}
+
+static inline void ddr_mt_check(struct ddr_mt_chunk *c, size_t i, u64 expected)
+{
+    u64 actual = ddr_be->read(c->vaddr + i * DDR_MT_WIDTH, DDR_MT_WIDTH);
+
+    expected &= DDR_MT_MASK;
+    if (likely(actual == expected))
+        return;
+
+    if (c->nfails < DDR_MEMTEST_MAX_FAILS) {
+        c->fails[c->nfails].addr = c->base + i * DDR_MT_WIDTH;
+        c->fails[c->nfails].expected = expected;
+        c->fails[c->nfails].actual = actual;
+        c->nfails++;
+    }
+    c->errors++;
+}
+
+// Called once per element; true when the test should stop
+static inline bool ddr_mt_stop(struct ddr_mt_chunk *c, size_t i)
+{
+    if (i % DDR_MT_YIELD)
+        return false;
+    cond_resched();
+    return READ_ONCE(c->job->abort);
+}
+
+// splitmix64 finaliser: a reproducible value per (seed, pass, address)
+static inline u64 ddr_mt_mix(u64 x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static u64 ddr_mt_value(struct ddr_mt_chunk *c, unsigned int pattern, u32 pass, size_t i)
+{
+    u64 addr = c->base + i * DDR_MT_WIDTH;
+    u64 bit;
+
+    switch (pattern) {
+    case DDR_MT_WALK_ONES:
+    case DDR_MT_WALK_ZEROS:
+        bit = 1ULL << ((i + pass) % (DDR_MT_WIDTH * 8));
+        return pattern == DDR_MT_WALK_ONES ? bit : ~bit;
+    case DDR_MT_ADDRESS:
+        return pass & 1 ? ~addr : addr;
+    default:
+        return ddr_mt_mix(c->job->args->seed + pass * 0x9e3779b97f4a7c15ULL + addr);
+    }
+}
+
+/* One write sweep then one verify sweep of a data pattern. */
+static int ddr_mt_fill(struct ddr_mt_chunk *c, unsigned int pattern, u32 pass)
+{
+    size_t i;
+
+    for (i = 0; i < c->n; i++) {
+        if (ddr_mt_stop(c, i))
+            return -EINTR;
+        ddr_mt_write(c, i, ddr_mt_value(c, pattern, pass, i));
+    }
+    for (i = 0; i < c->n; i++) {
+        if (ddr_mt_stop(c, i))
+            return -EINTR;
+        ddr_mt_check(c, i, ddr_mt_value(c, pattern, pass, i));
+    }
+    c->bytes += 2 * c->n * DDR_MT_WIDTH;
+    return 0;
+}
+
+/* March C-: (w0) up(r0,w1) up(r1,w0) down(r0,w1) down(r1,w0) (r0). */
+static int ddr_mt_march(struct ddr_mt_chunk *c)
+{
+    static const struct {
+        bool down;
+        u64 r, w;
+    } elems[] = {
+        { false, 0, 0 },                // w0 (r ignored)
+        { false, 0, ~0ULL },
+        { false, ~0ULL, 0 },
+        { true, 0, ~0ULL },
+        { true, ~0ULL, 0 },
+        { false, 0, 0 },                // r0 (w ignored)
+    };
+    size_t i, k, e;
+
+    for (e = 0; e < ARRAY_SIZE(elems); e++) {
+        for (k = 0; k < c->n; k++) {
+            if (ddr_mt_stop(c, k))
+                return -EINTR;
+            i = elems[e].down ? c->n - 1 - k : k;
+            if (e > 0)
+                ddr_mt_check(c, i, elems[e].r);
+            if (e < ARRAY_SIZE(elems) - 1)
+                ddr_mt_write(c, i, elems[e].w);
+        }
+    }
+    c->bytes += 10 * c->n * DDR_MT_WIDTH;
+    return 0;
+}
+
+static void ddr_mt_work(struct work_struct *work)
+{
+    struct ddr_mt_chunk *c = container_of(work, struct ddr_mt_chunk, work);
+    const struct ddr_memtest_args *args = c->job->args;
+    unsigned int p;
+    u32 pass;
+
+    c->vaddr = ddr_be->map(c->base, c->n * DDR_MT_WIDTH);
+    if (!c->vaddr) {
+        c->ret = -ENOMEM;
+        goto out;
+    }
+
+    for (pass = 0; pass < args->passes && !c->ret; pass++) {
+        for (p = 0; p <= DDR_MT_RANDOM && !c->ret; p++) {
+            if (!(args->patterns & BIT(p)))
+                continue;
+            if (p == DDR_MT_MARCH_C) {
+                c->ret = ddr_mt_march(c);
+            } else {
+                c->ret = ddr_mt_fill(c, p, p == DDR_MT_ADDRESS ? 0 : pass);
+                // address-in-address checks the complement as well
+                if (!c->ret && p == DDR_MT_ADDRESS)
+                    c->ret = ddr_mt_fill(c, p, 1);
+            }
+        }
+    }
+    ddr_be->unmap(c->vaddr);
+out:
+    if (atomic_dec_and_test(&c->job->pending))
+        complete(&c->job->done);
+}
+
+static int ddr_mt_fail_cmp(const void *a, const void *b)
+{
+    const struct ddr_memtest_fail *fa = a, *fb = b;
+
+    return fa->addr < fb->addr ? -1 : fa->addr > fb->addr;
+}
+
+static int ddr_memtest(unsigned long arg)
+{
+    struct ddr_held held;
+    struct ddr_memtest_args args;
+    struct ddr_mt_chunk *chunks, *c;
+    struct ddr_mt_job job;
+    unsigned int threads, i, j;
+    u64 chunk, end, off, elapsed;
+    ktime_t start;
+    int ret = 0;
+
+    if (!capable(CAP_SYS_ADMIN))
+        return -EPERM;
+    if (ddr_copy_from_user(&args, (void __user *)arg, sizeof(args)))
+        return -EFAULT;
+
+    if (args.flags || !args.patterns || (args.patterns & ~DDR_MT_ALL))
+        return -EINVAL;
+    if (!args.size || (args.addr | args.size) % DDR_MT_WIDTH)
+        return -EINVAL;
+    if (check_add_overflow(args.addr, args.size - 1, &end) || end > ULONG_MAX)
+        return -EINVAL;
+    if (!args.passes)
+        args.passes = 1;
+
+    // page-aligned chunks, no more of them than pages or threads asked for
+    threads = args.threads ? args.threads : num_online_cpus();
+    threads = min_t(u64, threads, DDR_MT_MAX_THREADS);
+    threads = min_t(u64, threads, DIV_ROUND_UP_ULL(args.size, PAGE_SIZE));
+    chunk = round_up(DIV_ROUND_UP_ULL(args.size, threads), PAGE_SIZE);
+    threads = DIV_ROUND_UP_ULL(args.size, chunk);
+
+    chunks = kvcalloc(threads, sizeof(*chunks), GFP_KERNEL);
+    if (!chunks)
+        return -ENOMEM;
+
+    job.args = &args;
+    atomic_set(&job.pending, threads);
+    init_completion(&job.done);
+    job.abort = false;
+
+    ddr_lock_range(args.addr, args.size, &held);
+    start = ktime_get();
+    for (i = 0, off = 0; i < threads; i++, off += chunk) {
+        c = &chunks[i];
+        c->job = &job;
+        c->base = args.addr + off;
+        c->n = min(chunk, args.size - off) / DDR_MT_WIDTH;
+        INIT_WORK(&c->work, ddr_mt_work);
+        queue_work(system_unbound_wq, &c->work);
+    }
+    if (wait_for_completion_killable(&job.done)) {
+        WRITE_ONCE(job.abort, true);
+        wait_for_completion(&job.done);
+    }
+    elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+    ddr_unlock_range(&held);
+
+    args.errors = 0;
+    args.bytes = 0;
+    args.nfails = 0;
+    for (i = 0; i < threads; i++) {
+        c = &chunks[i];
+        if (!ret)
+            ret = c->ret;
+        args.errors += c->errors;
+        args.bytes += c->bytes;
+
+        // chunks are in address order; keep the lowest failing addresses
+        sort(c->fails, c->nfails, sizeof(c->fails[0]), ddr_mt_fail_cmp, NULL);
+        for (j = 0; j < c->nfails && args.nfails < DDR_MEMTEST_MAX_FAILS; j++)
+            args.fails[args.nfails++] = c->fails[j];
+    }
+    kvfree(chunks);
+
+    args.elapsed_ns = elapsed;
+    args.mbps = div64_u64(args.bytes * 1000, elapsed ? elapsed : 1);
+    args.width = DDR_MT_WIDTH;
+    if (ddr_copy_to_user((void __user *)arg, &args, sizeof(args)))
+        return -EFAULT;
+    return ret;
+}
+
+/* Legacy single-word command, shared by the native and compat paths. */
+static int ddr_rw_word(bool write, unsigned long addr, u32 *value)
+{
+    int ret;
+    u64 t;
+
+    if (addr % 4 != 0 || addr > ULONG_MAX - 3)
+        return -EINVAL; // must be 32-bit aligned
+
+    // writes only land if the existing value is 0
+    t = ddr_trace_start();
+    ret = write ? ddr_write_words(addr, value, 1) : ddr_read_words(addr, value, 1);
+    trace_ddr_op(write ? DDR_TR_WRITE : DDR_TR_READ, addr, *value, 1, 4, ret, t);
+    return ret;
+}
+
+/* Legacy 256-word range command, shared by the native and compat paths. */
+static int ddr_rw_range(bool write, unsigned long addr, u32 *values, int count)
+{
+    int ret;
+    u64 t;
+
+    if (addr % 4 != 0)
+        return -EINVAL;
+
+    if (count < 0 || count > DDR_RANGE_MAX)
+        return -EINVAL;
+
+    t = ddr_trace_start();
+    ret = write ? ddr_write_words(addr, values, count) : ddr_read_words(addr, values, count);
+    trace_ddr_op(write ? DDR_TR_WRITE_RANGE : DDR_TR_READ_RANGE, addr, values[0], count, 4,
+                 ret, t);
+    return ret;
+}
+
+/*
+ * DDR_IO is matched on _IOC_NR alone: the size encoded in the command
+ * follows whichever struct ddr_io the caller was built with, and the
+ * size field says how much of it there is. copy_struct_from_user()
+ * zero-fills fields an older caller does not know and refuses (-E2BIG)
+ * non-zero fields this module does not know.
+ */
+static int ddr_io_cmd(unsigned long arg)
+{
+    struct ddr_io __user *uio = (void __user *)arg;
+    struct ddr_io io;
+    u32 usize;
+    void *bounce;
+    u64 value, t;
+    int ret;
+
+    if (get_user(usize, &uio->size))
+        return -EFAULT;
+    if (usize < DDR_IO_SIZE_VER0 || usize > PAGE_SIZE)
+        return -EINVAL;
+    ret = copy_struct_from_user(&io, sizeof(io), uio, usize);
+    if (ret)
+        return ret;
+
+    if (io.flags || (io.op != DDR_IO_READ && io.op != DDR_IO_WRITE))
+        return -EINVAL;
+    if (!io.width)
+        io.width = 4;   // callers built before width existed
+    if (!ddr_width_ok(io.width))
+        return -EOPNOTSUPP;
+    if (io.addr > ULONG_MAX || io.addr % io.width != 0)
+        return -EINVAL;
+
+    // one element carried in the struct itself
+    if (!io.buf) {
+        if (io.count != 1 || io.addr > ULONG_MAX - (io.width - 1))
+            return -EINVAL;
+        ddr_elem_set(&value, io.width, 0, io.value);
+        t = ddr_trace_start();
+        if (io.op == DDR_IO_WRITE)
+            ret = ddr_write_elems(io.addr, io.width, &value, 1);
+        else
+            ret = ddr_read_elems(io.addr, io.width, &value, 1);
+        trace_ddr_op(io.op == DDR_IO_WRITE ? DDR_TR_WRITE : DDR_TR_READ, io.addr,
+                     ddr_elem_get(&value, io.width, 0), 1, io.width, ret, t);
+        if (ret || io.op == DDR_IO_WRITE)
+            return ret;
+        return put_user(ddr_elem_get(&value, io.width, 0), &uio->value);
+    }
+
+    bounce = kmalloc(PAGE_SIZE, GFP_KERNEL);
+    if (!bounce)
+        return -ENOMEM;
+    ret = ddr_xfer_seg(io.addr, io.width, io.count, u64_to_user_ptr(io.buf), bounce,
+                       io.op == DDR_IO_WRITE);
+    kfree(bounce);
+    return ret;
+}
+
+static long ddr_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
     struct ddr_rw_args rw_args;
     struct ddr_range_args range_args;
-    void __iomem *vaddr;
-    int i;
+    int ret;
+
+    if (_IOC_TYPE(cmd) == DDR_IOC_MAGIC && _IOC_NR(cmd) == _IOC_NR(DDR_IO))
+        return ddr_io_cmd(arg);
 
     switch (cmd) {
     case DDR_READ:
-        if (copy_from_user(&rw_args, (void __user *)arg, sizeof(rw_args)))
+    case DDR_WRITE:
+        if (ddr_copy_from_user(&rw_args, (void __user *)arg, sizeof(rw_args)))
             return -EFAULT;
 
-        if (rw_args.addr % 4 != 0)
-            return -EINVAL; // must be 32-bit aligned
+        ret = ddr_rw_word(cmd == DDR_WRITE, rw_args.addr, &rw_args.value);
+        if (ret || cmd == DDR_WRITE)
+            return ret;
 
-        vaddr = ioremap(rw_args.addr, 4);
-        if (!vaddr)
-            return -ENOMEM;
+        if (ddr_copy_to_user((void __user *)arg, &rw_args, sizeof(rw_args)))
+            return -EFAULT;
+        break;
+
+    /*
+     * Fixed 256-word range ioctls, kept for existing tools. New code
+     * should use DDR_IO or DDR_READ_SG/DDR_WRITE_SG.
+     */
+    case DDR_READ_RANGE:
+    case DDR_WRITE_RANGE:
+        if (ddr_copy_from_user(&range_args, (void __user *)arg, sizeof(range_args)))
+            return -EFAULT;
 
-        rw_args.value = ioread32(vaddr);
-        iounmap(vaddr);
+        ret = ddr_rw_range(cmd == DDR_WRITE_RANGE, range_args.addr, range_args.values,
+                           range_args.count);
+        if (ret || cmd == DDR_WRITE_RANGE)
+            return ret;
 
-        if (copy_to_user((void __user *)arg, &rw_args, sizeof(rw_args)))
+        if (ddr_copy_to_user((void __user *)arg, &range_args, sizeof(range_args)))
             return -EFAULT;
         break;
 
-    case DDR_WRITE:
-        if (copy_from_user(&rw_args, (void __user *)arg, sizeof(rw_args)))
-            return -EFAULT;
+    case DDR_READ_SG:
+        return ddr_xfer(arg, false);
 
-        if (rw_args.addr % 4 != 0)
-            return -EINVAL;
+    case DDR_WRITE_SG:
+        return ddr_xfer(arg, true);
 
-        vaddr = ioremap(rw_args.addr, 4);
-        if (!vaddr)
-            return -ENOMEM;
+    case DDR_BATCH:
+        return ddr_batch(arg);
 
-        // check existing value before writing
-        if (ioread32(vaddr) == 0)
-            iowrite32(rw_args.value, vaddr);
+    case DDR_POLL:
+        return ddr_poll(arg);
 
-        iounmap(vaddr);
-        break;
+    case DDR_WATCH:
+        return ddr_watch_set(file->private_data, arg);
 
-    case DDR_READ_RANGE:
-        if (copy_from_user(&range_args, (void __user *)arg, sizeof(range_args)))
-            return -EFAULT;
+    case DDR_SAMPLE:
+        return ddr_sample_set(file->private_data, arg);
 
-        if (range_args.addr % 4 != 0)
-            return -EINVAL;
+    case DDR_MEMTEST:
+        return ddr_memtest(arg);
 
-        for (i = 0; i < range_args.count; i++) {
-            unsigned long addr = range_args.addr + i * 4;
-            vaddr = ioremap(addr, 4);
-            if (!vaddr)
-                return -ENOMEM;
+    default:
+        return -EINVAL;
+    }
 
-            range_args.values[i] = ioread32(vaddr);
-            iounmap(vaddr);
-        }
+    return 0;
+}
 
-        if (copy_to_user((void __user *)arg, &range_args, sizeof(range_args)))
-            return -EFAULT;
-        break;
+static long ddr_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    u64 t = ddr_stat_start();
+    long ret = ddr_do_ioctl(file, cmd, arg);
 
-    case DDR_WRITE_RANGE:
-        if (copy_from_user(&range_args, (void __user *)arg, sizeof(range_args)))
-            return -EFAULT;
+    ddr_stat_cmd(cmd, t, ret);
+    return ret;
+}
 
-        if (range_args.addr % 4 != 0)
-            return -EINVAL;
+#ifdef CONFIG_COMPAT
+/*
+ * The legacy rw/range structs hold an unsigned long, so 32-bit callers
+ * use a different layout and, through the encoded size, different
+ * command numbers. Every other struct is fixed-width and shared.
+ */
+struct ddr_rw_args32 {
+    compat_ulong_t addr;
+    u32 value;
+};
 
-        for (i = 0; i < range_args.count; i++) {
-            unsigned long addr = range_args.addr + i * 4;
-            vaddr = ioremap(addr, 4);
-            if (!vaddr)
-                return -ENOMEM;
+struct ddr_range_args32 {
+    compat_ulong_t addr;
+    u32 values[DDR_RANGE_MAX];
+    s32 count;
+};
+
+#define DDR_READ32        _IOWR(DDR_IOC_MAGIC, 1, struct ddr_rw_args32)
+#define DDR_WRITE32       _IOW(DDR_IOC_MAGIC,  2, struct ddr_rw_args32)
+#define DDR_READ_RANGE32  _IOWR(DDR_IOC_MAGIC, 3, struct ddr_range_args32)
+#define DDR_WRITE_RANGE32 _IOW(DDR_IOC_MAGIC,  4, struct ddr_range_args32)
+
+static long ddr_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    void __user *uptr = compat_ptr(arg);
+    struct ddr_range_args32 *range;
+    struct ddr_rw_args32 rw;
+    u32 value;
+    long ret;
+    u64 t;
 
-            // write only if empty (0)
-            if (ioread32(vaddr) == 0)
-                iowrite32(range_args.values[i], vaddr);
+    switch (cmd) {
+    case DDR_READ32:
+    case DDR_WRITE32:
+        t = ddr_stat_start();
+        if (ddr_copy_from_user(&rw, uptr, sizeof(rw))) {
+            ret = -EFAULT;
+        } else {
+            value = rw.value;
+            ret = ddr_rw_word(cmd == DDR_WRITE32, rw.addr, &value);
+            rw.value = value;
+            if (!ret && cmd == DDR_READ32 && ddr_copy_to_user(uptr, &rw, sizeof(rw)))
+                ret = -EFAULT;
+        }
+        ddr_stat_cmd(cmd, t, ret);
+        return ret;
 
-            iounmap(vaddr);
+    case DDR_READ_RANGE32:
+    case DDR_WRITE_RANGE32:
+        t = ddr_stat_start();
+        range = kmalloc(sizeof(*range), GFP_KERNEL);
+        if (!range) {
+            ret = -ENOMEM;
+        } else if (ddr_copy_from_user(range, uptr, sizeof(*range))) {
+            ret = -EFAULT;
+        } else {
+            ret = ddr_rw_range(cmd == DDR_WRITE_RANGE32, range->addr, range->values,
+                               range->count);
+            if (!ret && cmd == DDR_READ_RANGE32 &&
+                ddr_copy_to_user(uptr, range, sizeof(*range)))
+                ret = -EFAULT;
         }
-        break;
+        kfree(range);
+        ddr_stat_cmd(cmd, t, ret);
+        return ret;
 
     default:
+        return ddr_ioctl(file, cmd, (unsigned long)uptr);
+    }
+}
+#endif
+
+static int ddr_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    unsigned long size = vma->vm_end - vma->vm_start;
+    unsigned long phys = vma->vm_pgoff << PAGE_SHIFT;
+    struct ddr_client *c = file->private_data;
+
+    // /dev/ddr_sample maps its sample ring instead of physical memory
+    if (c->sample_node)
+        return ddr_sample_mmap(c, vma);
+
+    if (!mmap_size)
+        return -ENODEV;
+
+    // whole mapping must sit inside the whitelisted window
+    if (phys < mmap_base || size > mmap_size || phys - mmap_base > mmap_size - size)
+        return -EPERM;
+
+    return ddr_be->mmap(vma, phys, size);
+}
+
+/* Watch events; returns 0 (end of file) when no watchlist is armed. */
+static ssize_t ddr_read_events(struct file *file, char __user *buf, size_t len, loff_t *ppos)
+{
+    struct ddr_client *c = file->private_data;
+    unsigned int copied;
+    int ret;
+
+    if (len < sizeof(struct ddr_watch_event))
         return -EINVAL;
+
+    for (;;) {
+        mutex_lock(&c->lock);
+        if (!kfifo_is_empty(&c->events)) {
+            ret = kfifo_to_user(&c->events, buf, len, &copied);
+            mutex_unlock(&c->lock);
+            return ret ? ret : copied;
+        }
+        if (!c->nwatch) {
+            mutex_unlock(&c->lock);
+            return 0;
+        }
+        mutex_unlock(&c->lock);
+
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(c->wait,
+                                       !kfifo_is_empty(&c->events) || !READ_ONCE(c->nwatch));
+        if (ret)
+            return ret;
     }
+}
+
+static __poll_t ddr_poll_events(struct file *file, poll_table *wait)
+{
+    struct ddr_client *c = file->private_data;
+
+    poll_wait(file, &c->wait, wait);
+    if (!kfifo_is_empty(&c->events))
+        return EPOLLIN | EPOLLRDNORM;
+    // nothing armed: read() returns end of file, so say so
+    if (!READ_ONCE(c->nwatch))
+        return EPOLLIN | EPOLLRDNORM | EPOLLHUP;
+    return 0;
+}
+
+static int ddr_open(struct inode *inode, struct file *file)
+{
+    struct ddr_client *c;
+
+    c = kzalloc(sizeof(*c), GFP_KERNEL);
+    if (!c)
+        return -ENOMEM;
+
+    mutex_init(&c->lock);
+    INIT_KFIFO(c->events);
+    init_waitqueue_head(&c->wait);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,15,0)
+    hrtimer_setup(&c->timer, ddr_watch_sample, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+#else
+    hrtimer_init(&c->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+    c->timer.function = ddr_watch_sample;
+#endif
+
+    c->sample_node = iminor(inode) == DDR_SAMPLE_MINOR;
+    atomic_set(&c->sample.maps, 0);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,15,0)
+    hrtimer_setup(&c->sample.timer, ddr_sample_tick, CLOCK_MONOTONIC,
+                  HRTIMER_MODE_REL_PINNED_HARD);
+#else
+    hrtimer_init(&c->sample.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED_HARD);
+    c->sample.timer.function = ddr_sample_tick;
+#endif
 
+    file->private_data = c;
     return 0;
 }
 
+static int ddr_release(struct inode *inode, struct file *file)
+{
+    struct ddr_client *c = file->private_data;
+
+    mutex_lock(&c->lock);
+    ddr_watch_stop(c);
+    ddr_sample_stop(&c->sample);
+    mutex_unlock(&c->lock);
+    vfree(c->sample.ring);
+    kfree(c);
+    return 0;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,19,0)
+/*
+ * IORING_OP_URING_CMD: cmd_op is one of the ioctl numbers and the SQE
+ * command area holds a struct ddr_uring_cmd pointing at its argument.
+ * Every op may sleep, so the non-blocking inline issue is refused and
+ * io_uring runs the command from an io-wq worker; the submitting thread
+ * never blocks and many commands can be in flight at once. Commands from
+ * a 32-bit task's ring go through the compat_ioctl translation.
+ */
+static int ddr_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags)
+{
+    const struct ddr_uring_cmd *cmd;
+
+    if (issue_flags & IO_URING_F_NONBLOCK)
+        return -EAGAIN;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,7,0)
+    cmd = io_uring_sqe_cmd(ioucmd->sqe);
+#else
+    cmd = ioucmd->cmd;
+#endif
+#ifdef CONFIG_COMPAT
+    // a 32-bit ring passes the 32-bit legacy layouts, as compat_ioctl does
+    if (issue_flags & IO_URING_F_COMPAT)
+        return ddr_compat_ioctl(ioucmd->file, ioucmd->cmd_op,
+                                (unsigned long)READ_ONCE(cmd->arg));
+#endif
+    return ddr_ioctl(ioucmd->file, ioucmd->cmd_op, (unsigned long)READ_ONCE(cmd->arg));
+}
+#endif
+
 static struct file_operations fops = {
     .owner          = THIS_MODULE,
+    .open           = ddr_open,
+    .release        = ddr_release,
+    .read           = ddr_read_events,
+    .poll           = ddr_poll_events,
     .unlocked_ioctl = ddr_ioctl,
+#ifdef CONFIG_COMPAT
+    .compat_ioctl   = ddr_compat_ioctl,
+#endif
+    .mmap           = ddr_mmap,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,19,0)
+    .uring_cmd      = ddr_uring_cmd,
+#endif
 };
 
 static int __init ddr_init(void)
 {
+    int i;
+
+    for (i = 0; i < DDR_LOCK_BUCKETS; i++) {
+        mutex_init(&ddr_region_locks[i]);
+        lockdep_set_class(&ddr_region_locks[i], &ddr_region_keys[i]);
+    }
+
+    if (map_window_size < PAGE_SIZE || !is_power_of_2(map_window_size)) {
+        pr_warn("map_window_size %u invalid, using %lu\n", map_window_size, PAGE_SIZE);
+        map_window_size = PAGE_SIZE;
+    }
+
+    if ((mmap_base | mmap_size) & ~PAGE_MASK) {
+        pr_err("mmap_base/mmap_size must be page aligned\n");
+        return -EINVAL;
+    }
+
+    if (strcmp(backend, "sim") == 0) {
+        if (!sim_size || (sim_base | sim_size) & (map_window_size - 1)) {
+            pr_err("sim_base/sim_size must be non-zero multiples of map_window_size\n");
+            return -EINVAL;
+        }
+        sim_mem = vmalloc_user(sim_size);
+        if (!sim_mem)
+            return -ENOMEM;
+        ddr_be = &ddr_backend_sim;
+
+        // default the mmap window to the whole simulated region
+        if (!mmap_size) {
+            mmap_base = sim_base;
+            mmap_size = sim_size;
+        }
+    } else if (strcmp(backend, "mmio") != 0) {
+        pr_err("unknown backend \"%s\"\n", backend);
+        return -EINVAL;
+    }
+
+    ddr_stats = alloc_percpu(struct ddr_stats);
+    if (!ddr_stats) {
+        vfree(sim_mem);
+        return -ENOMEM;
+    }
+
     ddr_major = register_chrdev(0, DEVICE_NAME, &fops);
     if (ddr_major < 0) {
         pr_err("Failed to register char device\n");
+        free_percpu(ddr_stats);
+        vfree(sim_mem);
         return ddr_major;
     }
 
@@ -153,27 +2304,51 @@ static int __init ddr_init(void)
 #endif
     if (IS_ERR(ddr_class)) {
         unregister_chrdev(ddr_major, DEVICE_NAME);
+        free_percpu(ddr_stats);
+        vfree(sim_mem);
         pr_err("Failed to register device class\n");
         return PTR_ERR(ddr_class);
     }
 
-    ddr_device = device_create(ddr_class, NULL, MKDEV(ddr_major, 0), NULL, DEVICE_NAME);
+    ddr_device = device_create_with_groups(ddr_class, NULL, MKDEV(ddr_major, 0),
+                                           NULL, ddr_groups, DEVICE_NAME);
     if (IS_ERR(ddr_device)) {
         class_destroy(ddr_class);
         unregister_chrdev(ddr_major, DEVICE_NAME);
+        free_percpu(ddr_stats);
+        vfree(sim_mem);
         pr_err("Failed to create device\n");
         return PTR_ERR(ddr_device);
     }
 
-    pr_info("DDR module loaded successfully\n");
+    ddr_sample_device = device_create(ddr_class, NULL, MKDEV(ddr_major, DDR_SAMPLE_MINOR),
+                                      NULL, DDR_SAMPLE_NAME);
+    if (IS_ERR(ddr_sample_device)) {
+        device_destroy(ddr_class, MKDEV(ddr_major, 0));
+        class_destroy(ddr_class);
+        unregister_chrdev(ddr_major, DEVICE_NAME);
+        free_percpu(ddr_stats);
+        vfree(sim_mem);
+        pr_err("Failed to create sampler device\n");
+        return PTR_ERR(ddr_sample_device);
+    }
+
+    ddr_debugfs_init();
+
+    pr_info("DDR module loaded successfully (%s backend)\n", ddr_be->name);
     return 0;
 }
 
 static void __exit ddr_exit(void)
 {
+    debugfs_remove_recursive(ddr_debugfs);
+    device_destroy(ddr_class, MKDEV(ddr_major, DDR_SAMPLE_MINOR));
     device_destroy(ddr_class, MKDEV(ddr_major, 0));
     class_destroy(ddr_class);
     unregister_chrdev(ddr_major, DEVICE_NAME);
+    ddr_map_flush();
+    free_percpu(ddr_stats);
+    vfree(sim_mem);
     pr_info("DDR module unloaded\n");
 }
 
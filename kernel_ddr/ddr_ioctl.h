@@ -0,0 +1,279 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * ioctl interface of /dev/ddr, shared by ddr.c and every user space client.
+ */
+#ifndef DDR_IOCTL_H
+#define DDR_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define DDR_DEVICE_PATH "/dev/ddr"
+#define DDR_SAMPLE_PATH "/dev/ddr_sample"
+
+// IOCTL magic + commands
+#define DDR_IOC_MAGIC  'k'
+#define DDR_READ       _IOWR(DDR_IOC_MAGIC, 1, struct ddr_rw_args)
+#define DDR_WRITE      _IOW(DDR_IOC_MAGIC,  2, struct ddr_rw_args)
+#define DDR_READ_RANGE _IOWR(DDR_IOC_MAGIC, 3, struct ddr_range_args)
+#define DDR_WRITE_RANGE _IOW(DDR_IOC_MAGIC, 4, struct ddr_range_args)
+#define DDR_READ_SG    _IOW(DDR_IOC_MAGIC,  5, struct ddr_xfer_args)
+#define DDR_WRITE_SG   _IOW(DDR_IOC_MAGIC,  6, struct ddr_xfer_args)
+#define DDR_BATCH      _IOWR(DDR_IOC_MAGIC, 7, struct ddr_batch_args)
+#define DDR_POLL       _IOWR(DDR_IOC_MAGIC, 8, struct ddr_poll_args)
+#define DDR_WATCH      _IOW(DDR_IOC_MAGIC,  9, struct ddr_watch_args)
+#define DDR_SAMPLE     _IOWR(DDR_IOC_MAGIC, 10, struct ddr_sample_args)
+#define DDR_IO         _IOWR(DDR_IOC_MAGIC, 11, struct ddr_io)
+#define DDR_MEMTEST    _IOWR(DDR_IOC_MAGIC, 12, struct ddr_memtest_args)
+
+#define DDR_RANGE_MAX  256
+
+/*
+ * Legacy layouts: unsigned long makes them differ between 32- and 64-bit
+ * user space (the module translates both). New code should use DDR_IO.
+ */
+struct ddr_rw_args {
+    unsigned long addr;
+    __u32 value;
+};
+
+struct ddr_range_args {
+    unsigned long addr;
+    __u32 values[DDR_RANGE_MAX];
+    int count;
+};
+
+/*
+ * Versioned read/write. Set size to sizeof(struct ddr_io); the module
+ * accepts any size from DDR_IO_SIZE_VER0 up, treating fields it does not
+ * know as zero (-E2BIG if they are not) and fields the caller does not
+ * know as defaults, so new fields only ever get appended. With buf 0 and
+ * count 1 the element travels in value; otherwise buf points at count
+ * packed elements of width bytes.
+ *
+ * width is 1, 2, 4 or 8 (0 means 4) and addr must be a multiple of it.
+ * Every element is a single bus access, so an 8-byte read of a 64-bit
+ * counter is never torn; -EOPNOTSUPP on kernels without 64-bit MMIO.
+ */
+enum ddr_io_op {
+    DDR_IO_READ,
+    DDR_IO_WRITE,       // write-once, like DDR_WRITE
+};
+
+struct ddr_io {
+    __u32 size;
+    __u32 op;
+    __u64 addr;
+    __u64 value;
+    __u64 buf;
+    __u32 count;
+    __u32 flags;        // must be 0
+    __u32 width;        // VER1
+    __u32 pad;
+};
+
+#define DDR_IO_SIZE_VER0 40
+#define DDR_IO_SIZE_VER1 48
+
+struct ddr_seg {
+    __u64 addr;
+    __u64 count;    // 32-bit words
+};
+
+/*
+ * Unbounded transfer between DDR and a user buffer. With nsegs == 0 the
+ * single range [addr, addr + count * 4) is transferred; otherwise segs
+ * points at nsegs struct ddr_seg and buf holds their words back to back.
+ */
+struct ddr_xfer_args {
+    __u64 addr;
+    __u64 count;
+    __u64 buf;
+    __u64 segs;
+    __u32 nsegs;
+    __u32 flags;    // must be 0
+};
+
+enum ddr_batch_opcode {
+    DDR_OP_READ,    // value <- [addr]
+    DDR_OP_WRITE,   // [addr] <- value, fails with -EEXIST if non-zero
+    DDR_OP_CLEAR,   // [addr] <- 0
+    DDR_OP_POLL,    // wait until ([addr] & mask) == value, value <- last read
+};
+
+/*
+ * Unlike DDR_WRITE and the range writes, which skip a non-zero word and
+ * still succeed, DDR_OP_WRITE fails with -EEXIST so the batch stops
+ * there. DDR_OP_POLL takes the same conditions as DDR_POLL: a zero mask
+ * or value bits outside mask fail the op with -EINVAL.
+ */
+
+struct ddr_batch_op {
+    __u64 addr;
+    __u32 op;
+    __u32 value;
+    __u32 mask;
+    __s32 result;   // 0 or -errno
+};
+
+/*
+ * Ops run in order and stop at the first failure; failed is its index,
+ * or -1 if every op succeeded. Ops after a failure are left untouched.
+ */
+struct ddr_batch_args {
+    __u64 ops;
+    __u32 count;
+    __s32 failed;
+};
+
+/*
+ * Wait in the kernel until (value & mask) == expected or timeout_us
+ * passes (-ETIMEDOUT). Reads start back to back and back off to at most
+ * interval_us apart; 0 spins for up to 1 ms and then reads every 100 us.
+ * value and elapsed_ns are written back on success and on timeout. A
+ * zero mask, or expected bits outside mask, fails with -EINVAL.
+ */
+struct ddr_poll_args {
+    __u64 addr;
+    __u32 mask;
+    __u32 expected;
+    __u32 timeout_us;
+    __u32 interval_us;
+    __u32 value;        // out: last value read
+    __u32 pad;
+    __u64 elapsed_ns;   // out: time spent polling
+};
+
+/*
+ * Watchlist: the module samples every entry each period_us and queues a
+ * struct ddr_watch_event whenever (value & mask) changes. The fd turns
+ * readable (poll/select/epoll) and read() returns whole events; eventfd,
+ * if >= 0, is signalled as well. One watchlist per open file; a new
+ * DDR_WATCH replaces it and count 0 disarms it. Once the queue is drained
+ * with no watchlist armed, read() returns 0 (end of file) and poll()
+ * reports EPOLLIN | EPOLLHUP, so event loops see the end instead of
+ * waiting forever.
+ */
+struct ddr_watch_entry {
+    __u64 addr;
+    __u32 mask;
+    __u32 pad;
+};
+
+struct ddr_watch_args {
+    __u64 entries;      // user pointer to count struct ddr_watch_entry
+    __u32 count;        // 0..64
+    __u32 period_us;    // >= 100
+    __s32 eventfd;      // -1 for none
+    __u32 flags;        // must be 0
+};
+
+struct ddr_watch_event {
+    __u64 timestamp_ns; // CLOCK_MONOTONIC
+    __u64 addr;
+    __u32 index;        // position in the watchlist
+    __u32 old_value;
+    __u32 new_value;
+    __u32 dropped;      // events lost to a full queue before this one
+};
+
+/*
+ * High-rate sampling, on /dev/ddr_sample only. DDR_SAMPLE starts reading
+ * nregs registers every period_ns into a fresh ring of slots samples and
+ * returns ring_size; mmap() that many bytes at offset 0 to consume it.
+ * nregs 0 stops sampling. cpu >= 0 samples from a kthread busy-waiting
+ * on that CPU, -1 from a hard hrtimer. A new run needs the previous ring
+ * unmapped (-EBUSY otherwise).
+ */
+struct ddr_sample_args {
+    __u64 addrs;        // user pointer to nregs __u64 addresses
+    __u32 nregs;        // 0..16
+    __u32 period_ns;    // >= 10000
+    __u32 slots;        // power of two, <= 1 << 20
+    __s32 cpu;
+    __u64 ring_size;    // out
+};
+
+/*
+ * First page of the mapping; slots start at data_offset. The kernel
+ * advances head after filling a slot, the reader advances tail after
+ * consuming one (both free-running, slot = index & (slots - 1)). A full
+ * ring drops new samples and counts them in overruns; missed counts
+ * sample periods the producer could not keep up with.
+ */
+struct ddr_sample_ring {
+    __u32 head;
+    __u32 pad0[15];
+    __u32 tail;
+    __u32 pad1[15];
+    __u32 slots;
+    __u32 slot_size;
+    __u32 nregs;
+    __u32 period_ns;
+    __u64 data_offset;
+    __u64 overruns;
+    __u64 missed;
+};
+
+struct ddr_sample {
+    __u64 timestamp_ns; // CLOCK_MONOTONIC
+    __u32 values[];     // nregs values, slot padded to slot_size
+};
+
+/*
+ * Destructive memory test of [addr, addr + size), CAP_SYS_ADMIN only.
+ * Every pattern in the patterns mask runs in turn, passes times, with
+ * the range split into up to threads chunks tested in parallel (0 = one
+ * per online CPU). Accesses are 8 bytes wide on 64-bit kernels, 4
+ * otherwise (width); addr and size must be multiples of it. The
+ * write-once rule does not apply and the old contents are lost.
+ * Returns 0 even when errors were found; fails holds the nfails lowest
+ * failing addresses. -EINTR if the caller was killed.
+ */
+enum ddr_memtest_pattern {
+    DDR_MT_WALK_ONES,   // word i = 1 << ((i + pass) % bits)
+    DDR_MT_WALK_ZEROS,  // complement of the above
+    DDR_MT_MARCH_C,     // March C-: (w0) up(r0,w1) up(r1,w0) down(r0,w1) down(r1,w0) (r0)
+    DDR_MT_ADDRESS,     // each word holds its own address, then its complement
+    DDR_MT_RANDOM,      // hash of seed, pass and address
+};
+
+#define DDR_MT_ALL ((1u << (DDR_MT_RANDOM + 1)) - 1)
+#define DDR_MEMTEST_MAX_FAILS 16
+
+struct ddr_memtest_fail {
+    __u64 addr;
+    __u64 expected;
+    __u64 actual;
+};
+
+struct ddr_memtest_args {
+    __u64 addr;
+    __u64 size;         // bytes
+    __u64 seed;         // DDR_MT_RANDOM
+    __u32 patterns;     // mask of 1 << enum ddr_memtest_pattern
+    __u32 passes;       // 0 = 1
+    __u32 threads;
+    __u32 flags;        // must be 0
+    // out
+    __u64 errors;
+    __u64 bytes;        // bytes read and written
+    __u64 elapsed_ns;
+    __u32 mbps;         // bytes / elapsed, in 10^6 bytes per second
+    __u32 width;
+    __u32 nfails;
+    __u32 pad;
+    struct ddr_memtest_fail fails[DDR_MEMTEST_MAX_FAILS];
+};
+
+/*
+ * io_uring submission: IORING_OP_URING_CMD on the /dev/ddr fd with
+ * cmd_op set to one of the ioctl numbers above and this struct in the
+ * SQE command area. The CQE res is what the ioctl would have returned.
+ * The argument struct must stay valid until the completion is reaped.
+ */
+struct ddr_uring_cmd {
+    __u64 arg;      // user pointer to the command's argument struct
+};
+
+#endif // DDR_IOCTL_H
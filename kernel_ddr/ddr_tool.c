@@ -2,30 +2,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
 #include <errno.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
 
-#define DEVICE_PATH "/dev/ddr"
-
-// IOCTL definitions (must match ddr.c)
-#define DDR_IOC_MAGIC  'k'
-#define DDR_READ       _IOWR(DDR_IOC_MAGIC, 1, struct ddr_rw_args)
-#define DDR_WRITE      _IOW(DDR_IOC_MAGIC,  2, struct ddr_rw_args)
-#define DDR_READ_RANGE _IOWR(DDR_IOC_MAGIC, 3, struct ddr_range_args)
-#define DDR_WRITE_RANGE _IOW(DDR_IOC_MAGIC, 4, struct ddr_range_args)
-
-struct ddr_rw_args {
-    unsigned long addr;
-    unsigned int value;
-};
+#include "libddr/libddr.h"
 
-struct ddr_range_args {
-    unsigned long addr;
-    unsigned int values[256];
-    int count;
-};
+static const char *const op_names[] = { "read", "write", "clear", "poll" };
+static const char *const mt_names[] = { "walk1", "walk0", "march", "addr", "random" };
 
 static void usage(const char *prog)
 {
@@ -34,9 +19,150 @@ static void usage(const char *prog)
     printf("  %s write <addr> <value>\n", prog);
     printf("  %s read_range <addr> <count>\n", prog);
     printf("  %s write_range <addr> <v1> <v2> ...\n", prog);
+    printf("  %s readn <width> <addr> [count]\n", prog);
+    printf("  %s writen <width> <addr> <v1> [v2 ...]\n", prog);
+    printf("      <width> 1, 2, 4 or 8 bytes, one bus access per element\n");
+    printf("  %s dump <addr> <count> <file>\n", prog);
+    printf("  %s load <addr> <file>\n", prog);
+    printf("  %s batch <file>\n", prog);
+    printf("      script lines: read <addr> | write <addr> <value> | clear <addr>\n");
+    printf("                    poll <addr> <mask> <value>   ('#' starts a comment)\n");
+    printf("  %s poll <addr> <mask> <value> [timeout_us] [interval_us]\n", prog);
+    printf("      wait until (word & mask) == value; defaults 1000000 us, 100 us\n");
+    printf("  %s watch <period_us> <addr>[:mask] ...\n", prog);
+    printf("      print every change of the watched words until interrupted\n");
+    printf("  %s sample <period_ns> <samples> <file> <addr>[,<addr>...] [cpu]\n", prog);
+    printf("      stream timestamped samples to <file>; [cpu] pins a busy-wait sampler\n");
+    printf("  %s stats [on|off|reset]\n", prog);
+    printf("      latency counters from debugfs (mount it and enable first)\n");
+    printf("  %s memtest <addr> <size> [patterns] [threads] [passes] [seed]\n", prog);
+    printf("      destructive; patterns all (default) or walk1,walk0,march,addr,random\n");
+    printf("  %s stress <addr> <words> <threads> <rounds>\n", prog);
+    printf("      uses <words> * (<threads> + 1) words from <addr>; contents are destroyed\n");
     exit(1);
 }
 
+/* readn/writen: argv is <width> <addr> followed by [count] or the values. */
+static int run_width(ddr_dev *dev, int write, int argc, char **argv)
+{
+    unsigned int width = strtoul(argv[0], NULL, 0);
+    unsigned long addr = strtoul(argv[1], NULL, 0);
+    size_t count = write ? (size_t)(argc - 2) : argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+    uint64_t *values;
+    void *buf;
+    size_t i;
+    int ret;
+
+    if (width != 1 && width != 2 && width != 4 && width != 8) {
+        fprintf(stderr, "Error: width must be 1, 2, 4 or 8\n");
+        return 1;
+    }
+    if (addr % width != 0) {
+        fprintf(stderr, "Error: Address 0x%lx is not %u-byte aligned\n", addr, width);
+        return 1;
+    }
+    if (count == 0)
+        return 1;
+
+    values = calloc(count, sizeof(*values));
+    buf = calloc(count, width);
+    if (!values || !buf) {
+        perror("calloc");
+        free(values);
+        free(buf);
+        return 1;
+    }
+
+    // the library takes packed elements of the access width
+    if (write) {
+        for (i = 0; i < count; i++) {
+            values[i] = strtoull(argv[2 + i], NULL, 0);
+            switch (width) {
+            case 1: ((uint8_t *)buf)[i] = values[i]; break;
+            case 2: ((uint16_t *)buf)[i] = values[i]; break;
+            case 4: ((uint32_t *)buf)[i] = values[i]; break;
+            case 8: ((uint64_t *)buf)[i] = values[i]; break;
+            }
+        }
+        ret = count == 1 ? ddr_write_width(dev, addr, width, values[0])
+                         : ddr_write_range_width(dev, addr, width, buf, count);
+    } else if (count == 1) {
+        ret = ddr_read_width(dev, addr, width, &values[0]);
+    } else {
+        ret = ddr_read_range_width(dev, addr, width, buf, count);
+        for (i = 0; i < count; i++) {
+            switch (width) {
+            case 1: values[i] = ((uint8_t *)buf)[i]; break;
+            case 2: values[i] = ((uint16_t *)buf)[i]; break;
+            case 4: values[i] = ((uint32_t *)buf)[i]; break;
+            case 8: values[i] = ((uint64_t *)buf)[i]; break;
+            }
+        }
+    }
+
+    if (ret) {
+        fprintf(stderr, "%s: %s\n", write ? "writen" : "readn", ddr_strerror(ret));
+    } else if (write) {
+        printf("Wrote %zu %u-byte values to 0x%lx (only if previously 0)\n", count, width, addr);
+    } else {
+        for (i = 0; i < count; i++)
+            printf("  [0x%lx] = 0x%0*llx\n", addr + i * width, (int)width * 2,
+                   (unsigned long long)values[i]);
+    }
+    free(values);
+    free(buf);
+    return ret ? 1 : 0;
+}
+
+static int run_memtest(ddr_dev *dev, int argc, char **argv)
+{
+    struct ddr_memtest_args args;
+    char *list, *name, *save;
+    unsigned int i;
+    int ret;
+
+    memset(&args, 0, sizeof(args));
+    args.addr = strtoull(argv[0], NULL, 0);
+    args.size = strtoull(argv[1], NULL, 0);
+    args.patterns = DDR_MT_ALL;
+    if (argc > 2 && strcmp(argv[2], "all") != 0) {
+        args.patterns = 0;
+        list = strdup(argv[2]);
+        for (name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+            for (i = 0; i < sizeof(mt_names) / sizeof(mt_names[0]); i++)
+                if (strcmp(name, mt_names[i]) == 0)
+                    break;
+            if (i == sizeof(mt_names) / sizeof(mt_names[0])) {
+                fprintf(stderr, "unknown pattern \"%s\"\n", name);
+                free(list);
+                return -1;
+            }
+            args.patterns |= 1u << i;
+        }
+        free(list);
+    }
+    if (argc > 3) args.threads = strtoul(argv[3], NULL, 0);
+    if (argc > 4) args.passes = strtoul(argv[4], NULL, 0);
+    if (argc > 5) args.seed = strtoull(argv[5], NULL, 0);
+
+    ret = ddr_memtest(dev, &args);
+    if (ret) {
+        fprintf(stderr, "memtest: %s\n", ddr_strerror(ret));
+        return -1;
+    }
+
+    printf("Tested 0x%llx bytes at 0x%llx (%u-byte accesses): %llu errors, "
+           "%.3f s, %u MB/s\n", (unsigned long long)args.size,
+           (unsigned long long)args.addr, args.width, (unsigned long long)args.errors,
+           args.elapsed_ns / 1e9, args.mbps);
+    for (i = 0; i < args.nfails; i++)
+        printf("  [0x%llx] expected 0x%llx read 0x%llx\n",
+               (unsigned long long)args.fails[i].addr,
+               (unsigned long long)args.fails[i].expected,
+               (unsigned long long)args.fails[i].actual);
+    return args.errors ? -1 : 0;
+}
+
 // Check for 32-bit alignment
 static int check_alignment(unsigned long addr)
 {
@@ -47,84 +173,784 @@ static int check_alignment(unsigned long addr)
     return 0;
 }
 
-int main(int argc, char *argv[])
+// Arm a watchlist from "addr[:mask]" arguments and print events as they arrive
+static int run_watch(ddr_dev *dev, uint32_t period_us, char **specs, int nspecs)
+{
+    struct ddr_watch_entry entries[64];
+    struct ddr_watch_event events[64];
+    char *end;
+    int i, n, ret;
+
+    if (nspecs > 64) {
+        fprintf(stderr, "watch: at most 64 addresses\n");
+        return -1;
+    }
+
+    memset(entries, 0, sizeof(entries));
+    for (i = 0; i < nspecs; i++) {
+        entries[i].addr = strtoul(specs[i], &end, 0);
+        entries[i].mask = *end == ':' ? strtoul(end + 1, NULL, 0) : 0xffffffff;
+        if (check_alignment(entries[i].addr) < 0)
+            return -1;
+    }
+
+    ret = ddr_watch(dev, entries, nspecs, period_us, -1);
+    if (ret) {
+        fprintf(stderr, "watch: %s\n", ddr_strerror(ret));
+        return -1;
+    }
+
+    printf("Watching %d address(es) every %u us\n", nspecs, period_us);
+    fflush(stdout);
+    for (;;) {
+        n = ddr_watch_read(dev, events, 64, -1);
+        if (n < 0) {
+            fprintf(stderr, "watch: %s\n", ddr_strerror(n));
+            return -1;
+        }
+        for (i = 0; i < n; i++) {
+            if (events[i].dropped)
+                printf("  (%u events dropped)\n", events[i].dropped);
+            printf("%llu.%09llu [0x%llx] 0x%x -> 0x%x\n",
+                   (unsigned long long)(events[i].timestamp_ns / 1000000000ULL),
+                   (unsigned long long)(events[i].timestamp_ns % 1000000000ULL),
+                   (unsigned long long)events[i].addr,
+                   events[i].old_value, events[i].new_value);
+        }
+        fflush(stdout);
+    }
+}
+
+/*
+ * Sample file: this header, nregs 64-bit addresses, then slot_size-byte
+ * struct ddr_sample records as laid out in the kernel ring.
+ */
+struct sample_file_header {
+    char magic[4];          // "DDRS"
+    uint32_t version;       // 1
+    uint32_t nregs;
+    uint32_t period_ns;
+    uint32_t slot_size;
+    uint32_t pad;
+};
+
+#define SAMPLE_CHUNK 4096
+
+static int run_sample(uint32_t period_ns, uint64_t total, const char *path,
+                      char *addr_list, int cpu)
+{
+    struct sample_file_header hdr = { .magic = "DDRS", .version = 1 };
+    uint64_t addrs[16], got = 0, overruns, missed;
+    ddr_sampler *s;
+    unsigned char *buf;
+    char *tok, *save;
+    uint32_t slots = 4096;
+    FILE *f;
+    int nregs = 0, n, ret;
+
+    if (!period_ns) {
+        fprintf(stderr, "sample: period must be non-zero\n");
+        return -1;
+    }
+
+    for (tok = strtok_r(addr_list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (nregs == 16) {
+            fprintf(stderr, "sample: at most 16 addresses\n");
+            return -1;
+        }
+        addrs[nregs] = strtoull(tok, NULL, 0);
+        if (check_alignment(addrs[nregs]) < 0)
+            return -1;
+        nregs++;
+    }
+
+    // room for a quarter second of samples between our 1 ms naps
+    while (slots < (1u << 20) && slots < 250000000u / period_ns)
+        slots <<= 1;
+    ret = ddr_sample_open(NULL, addrs, nregs, period_ns, slots, cpu, &s);
+    if (ret) {
+        fprintf(stderr, "sample: %s\n", ddr_strerror(ret));
+        return -1;
+    }
+
+    f = fopen(path, "wb");
+    buf = malloc(SAMPLE_CHUNK * ddr_sample_slot_size(s));
+    if (!f || !buf) {
+        perror(path);
+        goto err;
+    }
+
+    hdr.nregs = nregs;
+    hdr.period_ns = period_ns;
+    hdr.slot_size = ddr_sample_slot_size(s);
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+        fwrite(addrs, sizeof(addrs[0]), nregs, f) != (size_t)nregs) {
+        perror(path);
+        goto err;
+    }
+
+    while (got < total) {
+        n = ddr_sample_read(s, buf, total - got < SAMPLE_CHUNK ? total - got : SAMPLE_CHUNK);
+        if (n == 0) {
+            usleep(1000);
+            continue;
+        }
+        if (fwrite(buf, ddr_sample_slot_size(s), n, f) != (size_t)n) {
+            perror(path);
+            goto err;
+        }
+        got += n;
+    }
+
+    ddr_sample_stats(s, &overruns, &missed);
+    printf("Wrote %llu samples of %d registers to %s (%llu overruns, %llu missed periods)\n",
+           (unsigned long long)got, nregs, path,
+           (unsigned long long)overruns, (unsigned long long)missed);
+    free(buf);
+    ddr_sample_close(s);
+    return fclose(f) == 0 ? 0 : -1;
+
+err:
+    free(buf);
+    if (f)
+        fclose(f);
+    ddr_sample_close(s);
+    return -1;
+}
+
+#define DDR_DEBUGFS "/sys/kernel/debug/ddr/"
+#define STAT_BUCKETS 32
+
+// Format nanoseconds with a unit that keeps it short
+static const char *fmt_ns(double ns, char *buf, size_t len)
 {
-    int fd;
-    struct ddr_rw_args rw_args;
-    struct ddr_range_args range_args;
+    if (ns < 1e3)
+        snprintf(buf, len, "%.0fns", ns);
+    else if (ns < 1e6)
+        snprintf(buf, len, "%.1fus", ns / 1e3);
+    else
+        snprintf(buf, len, "%.1fms", ns / 1e6);
+    return buf;
+}
+
+// Upper bound of the bucket holding the given fraction of samples
+static double bucket_percentile(const unsigned long long *b, unsigned long long count, double frac)
+{
+    unsigned long long seen = 0;
     int i;
 
-    if (argc < 3)
+    for (i = 0; i < STAT_BUCKETS; i++) {
+        seen += b[i];
+        if (seen && seen >= frac * count)
+            return (double)(2ULL << i);
+    }
+    return (double)(2ULL << (STAT_BUCKETS - 1));
+}
+
+static int write_debugfs(const char *file, const char *val)
+{
+    char path[128];
+    FILE *f;
+
+    snprintf(path, sizeof(path), DDR_DEBUGFS "%s", file);
+    f = fopen(path, "w");
+    if (!f || fputs(val, f) < 0 || fclose(f) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+static int show_stats(void)
+{
+    unsigned long long count, errors, total, b[STAT_BUCKETS], peak;
+    char kind[16], name[32], avg[16], p50[16], p99[16];
+    char line[1024], *p;
+    FILE *f;
+    int i, n, len;
+
+    f = fopen(DDR_DEBUGFS "stats", "r");
+    if (!f) {
+        perror(DDR_DEBUGFS "stats");
+        return -1;
+    }
+
+    printf("%-6s %-12s %10s %8s %9s %9s %9s\n",
+           "", "name", "count", "errors", "avg", "p50<=", "p99<=");
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%15s %31s %llu %llu %llu%n", kind, name, &count, &errors, &total, &n) != 5)
+            continue;
+        p = line + n;
+        for (i = 0; i < STAT_BUCKETS; i++)
+            b[i] = strtoull(p, &p, 10);
+        if (!count)
+            continue;
+
+        printf("%-6s %-12s %10llu %8llu %9s %9s %9s\n", kind, name, count, errors,
+               fmt_ns((double)total / count, avg, sizeof(avg)),
+               fmt_ns(bucket_percentile(b, count, 0.5), p50, sizeof(p50)),
+               fmt_ns(bucket_percentile(b, count, 0.99), p99, sizeof(p99)));
+
+        // one bar per non-empty log2 bucket, labelled with its lower bound
+        peak = 0;
+        for (i = 0; i < STAT_BUCKETS; i++)
+            if (b[i] > peak)
+                peak = b[i];
+        for (i = 0; i < STAT_BUCKETS; i++) {
+            if (!b[i])
+                continue;
+            len = (int)(40 * b[i] / peak);
+            printf("%27s %10llu %.*s\n", fmt_ns((double)(1ULL << i), avg, sizeof(avg)), b[i],
+                   len ? len : 1, "########################################");
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+// Read <count> words at <addr> into a raw little-endian file
+static int dump_words(ddr_dev *dev, unsigned long addr, size_t count, const char *path)
+{
+    unsigned int *buf;
+    FILE *f;
+    int ret;
+
+    buf = malloc(count * 4);
+    if (!buf) {
+        perror("malloc");
+        return -1;
+    }
+
+    ret = ddr_read_range(dev, addr, buf, count);
+    if (ret) {
+        fprintf(stderr, "dump: %s\n", ddr_strerror(ret));
+        free(buf);
+        return -1;
+    }
+
+    f = fopen(path, "wb");
+    if (!f || fwrite(buf, 4, count, f) != count) {
+        perror(path);
+        ret = -1;
+    }
+    if (f)
+        fclose(f);
+    free(buf);
+    return ret;
+}
+
+// Write a raw little-endian word file to <addr>
+static int load_words(ddr_dev *dev, unsigned long addr, const char *path, size_t *count)
+{
+    unsigned int *buf;
+    FILE *f;
+    long len;
+    int ret;
+
+    f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    rewind(f);
+    if (len <= 0 || len % 4 != 0) {
+        fprintf(stderr, "Error: %s size must be a non-zero multiple of 4\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    *count = len / 4;
+    buf = malloc(len);
+    if (!buf || fread(buf, 4, *count, f) != *count) {
+        perror(path);
+        free(buf);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    ret = ddr_write_range(dev, addr, buf, *count);
+    free(buf);
+    if (ret) {
+        fprintf(stderr, "load: %s\n", ddr_strerror(ret));
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Compile a batch script into an op array. Returns the number of ops, or
+ * -1 after reporting the offending line.
+ */
+/*
+ * Up to max unsigned numbers (any strtoul base prefix) after the op name;
+ * returns how many were found, or -1 on anything else on the line.
+ */
+static int parse_args(char *p, unsigned long *vals, int max)
+{
+    char *end;
+    int n = 0;
+
+    for (;;) {
+        while (isspace((unsigned char)*p))
+            p++;
+        if (!*p)
+            return n;
+        if (n == max || *p == '-')
+            return -1;
+        errno = 0;
+        vals[n] = strtoul(p, &end, 0);
+        if (end == p || errno || (*end && !isspace((unsigned char)*end)))
+            return -1;
+        n++;
+        p = end;
+    }
+}
+
+static int parse_batch(const char *path, struct ddr_batch_op **out)
+{
+    struct ddr_batch_op *ops = NULL, *op;
+    char line[256], name[16];
+    unsigned long v[3], addr, a, b;
+    int count = 0, cap = 0, lineno = 0, n, len;
+    FILE *f;
+    char *p;
+
+    f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        p = strchr(line, '#');
+        if (p)
+            *p = '\0';
+
+        if (sscanf(line, "%15s%n", name, &len) != 1)
+            continue;
+        v[1] = v[2] = 0;
+        n = parse_args(line + len, v, 3);
+        if (n < 1 || (n > 1 && v[1] > 0xffffffffUL) || (n > 2 && v[2] > 0xffffffffUL)) {
+            fprintf(stderr, "%s:%d: bad batch op\n", path, lineno);
+            goto err;
+        }
+        n++;    // count the name, as the cases below expect
+        addr = v[0];
+        a = v[1];
+        b = v[2];
+
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            op = realloc(ops, cap * sizeof(*ops));
+            if (!op) {
+                perror("realloc");
+                goto err;
+            }
+            ops = op;
+        }
+        op = &ops[count];
+        memset(op, 0, sizeof(*op));
+        op->addr = addr;
+
+        if (strcmp(name, "read") == 0 && n == 2) {
+            op->op = DDR_OP_READ;
+        } else if (strcmp(name, "write") == 0 && n == 3) {
+            op->op = DDR_OP_WRITE;
+            op->value = a;
+        } else if (strcmp(name, "clear") == 0 && n == 2) {
+            op->op = DDR_OP_CLEAR;
+        } else if (strcmp(name, "poll") == 0 && n == 4) {
+            op->op = DDR_OP_POLL;
+            op->mask = a;
+            op->value = b;
+        } else {
+            fprintf(stderr, "%s:%d: bad batch op\n", path, lineno);
+            goto err;
+        }
+        if (check_alignment(addr) < 0)
+            goto err;
+        count++;
+    }
+
+    fclose(f);
+    *out = ops;
+    return count;
+err:
+    fclose(f);
+    free(ops);
+    return -1;
+}
+
+static int run_batch(ddr_dev *dev, const char *path)
+{
+    struct ddr_batch_op *ops = NULL;
+    int count, i, last, failed, ret;
+
+    count = parse_batch(path, &ops);
+    if (count <= 0)
+        return count;
+
+    ret = ddr_batch(dev, ops, count, &failed);
+    if (ret) {
+        fprintf(stderr, "batch: %s\n", ddr_strerror(ret));
+        free(ops);
+        return -1;
+    }
+
+    last = failed < 0 ? count - 1 : failed;
+    for (i = 0; i <= last; i++) {
+        printf("  [%d] %-5s 0x%llx", i, op_names[ops[i].op], ops[i].addr);
+        if (ops[i].op == DDR_OP_READ || ops[i].op == DDR_OP_POLL)
+            printf(" = 0x%x", ops[i].value);
+        if (ops[i].result)
+            printf(" : %s", strerror(-ops[i].result));
+        printf("\n");
+    }
+
+    free(ops);
+    if (failed >= 0) {
+        fprintf(stderr, "Batch stopped at op %d of %d\n", failed, count);
+        return -1;
+    }
+    printf("Batch of %d ops completed\n", count);
+    return 0;
+}
+
+/*
+ * Multithreaded write-once stress. Every thread opens its own handle and
+ * hammers a region shared by all threads plus a private region of its own
+ * with single and range writes, then reads the span back. Once a word is non-zero it
+ * must never change again until it is cleared between rounds, and a word
+ * that was just written must not read back as zero.
+ */
+struct stress_ctx {
+    unsigned long addr;
+    unsigned int words;
+    int threads;
+    int rounds;
+    unsigned int *observed;
+    unsigned long violations;
+    unsigned long errors;
+    pthread_barrier_t barrier;
+};
+
+struct stress_thread {
+    struct stress_ctx *ctx;
+    pthread_t tid;
+    int id;
+};
+
+static void stress_check(struct stress_ctx *ctx, unsigned int word, unsigned int value)
+{
+    unsigned int expected = 0;
+
+    if (value == 0 ||
+        (!__atomic_compare_exchange_n(&ctx->observed[word], &expected, value, 0,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) &&
+         expected != value)) {
+        __atomic_fetch_add(&ctx->violations, 1, __ATOMIC_RELAXED);
+        fprintf(stderr, "  violation at 0x%lx: read 0x%x, first seen 0x%x\n",
+                ctx->addr + word * 4UL, value, expected);
+    }
+}
+
+static int stress_clear(ddr_dev *dev, struct stress_ctx *ctx, unsigned int first,
+                        unsigned int count)
+{
+    struct ddr_batch_op *ops;
+    unsigned int i;
+    int failed, ret = 0;
+
+    ops = calloc(count, sizeof(*ops));
+    if (!ops)
+        return -1;
+    for (i = 0; i < count; i++) {
+        ops[i].op = DDR_OP_CLEAR;
+        ops[i].addr = ctx->addr + (first + i) * 4UL;
+        ctx->observed[first + i] = 0;
+    }
+
+    if (ddr_batch(dev, ops, count, &failed) || failed >= 0)
+        ret = -1;
+    free(ops);
+    return ret;
+}
+
+static void *stress_worker(void *arg)
+{
+    struct stress_thread *t = arg;
+    struct stress_ctx *ctx = t->ctx;
+    unsigned int values[256];
+    unsigned int seed = t->id * 7919 + 1;
+    unsigned int own = ctx->words * (t->id + 1);
+    unsigned int base, start, len, i;
+    int round, iter, ret;
+    ddr_dev *dev;
+
+    if (ddr_open(NULL, &dev)) {
+        perror("open");
+        __atomic_fetch_add(&ctx->errors, 1, __ATOMIC_RELAXED);
+        dev = NULL;
+    }
+
+    for (round = 0; round < ctx->rounds; round++) {
+        if (!dev) {
+            // keep the barrier count right even without a device
+            pthread_barrier_wait(&ctx->barrier);
+            pthread_barrier_wait(&ctx->barrier);
+            continue;
+        }
+
+        if (stress_clear(dev, ctx, own, ctx->words) < 0 ||
+            (t->id == 0 && stress_clear(dev, ctx, 0, ctx->words) < 0))
+            __atomic_fetch_add(&ctx->errors, 1, __ATOMIC_RELAXED);
+        pthread_barrier_wait(&ctx->barrier);
+
+        for (iter = 0; iter < 1000; iter++) {
+            base = (rand_r(&seed) & 1) ? own : 0;
+            len = 1 + rand_r(&seed) % (ctx->words < 256 ? ctx->words : 256);
+            start = base + rand_r(&seed) % (ctx->words - len + 1);
+
+            for (i = 0; i < len; i++)
+                values[i] = ((t->id + 1) << 24) | ((round & 0xff) << 16) | iter;
+            if (len == 1)
+                ret = ddr_write(dev, ctx->addr + start * 4UL, values[0]);
+            else
+                ret = ddr_write_range(dev, ctx->addr + start * 4UL, values, len);
+            // EEXIST is the expected outcome on modules that report it
+            if (ret && ret != DDR_ERR_EXISTS)
+                __atomic_fetch_add(&ctx->errors, 1, __ATOMIC_RELAXED);
+
+            if (ddr_read_range(dev, ctx->addr + start * 4UL, values, len)) {
+                __atomic_fetch_add(&ctx->errors, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            for (i = 0; i < len; i++)
+                stress_check(ctx, start + i, values[i]);
+        }
+        pthread_barrier_wait(&ctx->barrier);
+    }
+    ddr_close(dev);
+    return NULL;
+}
+
+static int run_stress(unsigned long addr, unsigned int words, int threads, int rounds)
+{
+    struct stress_ctx ctx = {0};
+    struct stress_thread *t;
+    int i;
+
+    if (words == 0 || threads <= 0 || rounds <= 0) {
+        fprintf(stderr, "Error: words, threads and rounds must be positive\n");
+        return -1;
+    }
+
+    ctx.addr = addr;
+    ctx.words = words;
+    ctx.threads = threads;
+    ctx.rounds = rounds;
+    ctx.observed = calloc((size_t)words * (threads + 1), sizeof(*ctx.observed));
+    t = calloc(threads, sizeof(*t));
+    if (!ctx.observed || !t) {
+        perror("calloc");
+        return -1;
+    }
+    pthread_barrier_init(&ctx.barrier, NULL, threads);
+
+    for (i = 0; i < threads; i++) {
+        t[i].ctx = &ctx;
+        t[i].id = i;
+        pthread_create(&t[i].tid, NULL, stress_worker, &t[i]);
+    }
+    for (i = 0; i < threads; i++)
+        pthread_join(t[i].tid, NULL);
+
+    pthread_barrier_destroy(&ctx.barrier);
+    free(ctx.observed);
+    free(t);
+
+    printf("Stress: %d threads x %d rounds over %u words: %lu violations, %lu ioctl errors\n",
+           threads, rounds, words, ctx.violations, ctx.errors);
+    return ctx.violations || ctx.errors ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    ddr_dev *dev;
+    unsigned long addr;
+    unsigned int value, *values;
+    size_t count;
+    int i, ret;
+
+    if (argc < 2 || (argc < 3 && strcmp(argv[1], "stats") != 0))
         usage(argv[0]);
 
-    fd = open(DEVICE_PATH, O_RDWR);
-    if (fd < 0) {
+    // stats only talks to debugfs, so it works without /dev/ddr access
+    if (strcmp(argv[1], "stats") == 0) {
+        if (argc > 2 && strcmp(argv[2], "on") == 0)
+            ret = write_debugfs("enable", "1");
+        else if (argc > 2 && strcmp(argv[2], "off") == 0)
+            ret = write_debugfs("enable", "0");
+        else if (argc > 2 && strcmp(argv[2], "reset") == 0)
+            ret = write_debugfs("reset", "1");
+        else
+            ret = show_stats();
+        return ret < 0 ? 1 : 0;
+    }
+
+    if (ddr_open(NULL, &dev)) {
         perror("open");
         return 1;
     }
 
     if (strcmp(argv[1], "read") == 0) {
-        rw_args.addr = strtoul(argv[2], NULL, 0);
-        if (check_alignment(rw_args.addr) < 0) { close(fd); return 1; }
+        addr = strtoul(argv[2], NULL, 0);
+        if (check_alignment(addr) < 0) { ddr_close(dev); return 1; }
 
-        if (ioctl(fd, DDR_READ, &rw_args) < 0) {
-            perror("ioctl DDR_READ");
-            close(fd);
+        ret = ddr_read(dev, addr, &value);
+        if (ret) {
+            fprintf(stderr, "read: %s\n", ddr_strerror(ret));
+            ddr_close(dev);
             return 1;
         }
-        printf("Value at 0x%lx = 0x%x\n", rw_args.addr, rw_args.value);
+        printf("Value at 0x%lx = 0x%x\n", addr, value);
 
     } else if (strcmp(argv[1], "write") == 0) {
         if (argc < 4) usage(argv[0]);
-        rw_args.addr = strtoul(argv[2], NULL, 0);
-        rw_args.value = strtoul(argv[3], NULL, 0);
-        if (check_alignment(rw_args.addr) < 0) { close(fd); return 1; }
+        addr = strtoul(argv[2], NULL, 0);
+        value = strtoul(argv[3], NULL, 0);
+        if (check_alignment(addr) < 0) { ddr_close(dev); return 1; }
+
+        ret = ddr_write(dev, addr, value);
+        if (ret) {
+            fprintf(stderr, "write: %s\n", ddr_strerror(ret));
+            ddr_close(dev);
+            return 1;
+        }
+        printf("Wrote 0x%x to 0x%lx (only if previously 0)\n", value, addr);
+
+    } else if (strcmp(argv[1], "read_range") == 0 || strcmp(argv[1], "write_range") == 0) {
+        int write = argv[1][0] == 'w';
+
+        if (argc < 4) usage(argv[0]);
+        addr = strtoul(argv[2], NULL, 0);
+        count = write ? (size_t)(argc - 3) : strtoul(argv[3], NULL, 0);
+        if (check_alignment(addr) < 0 || count == 0) { ddr_close(dev); return 1; }
+
+        values = calloc(count, sizeof(*values));
+        if (!values) { perror("calloc"); ddr_close(dev); return 1; }
+
+        if (write) {
+            for (i = 0; i < (int)count; i++)
+                values[i] = strtoul(argv[3 + i], NULL, 0);
+            ret = ddr_write_range(dev, addr, values, count);
+        } else {
+            ret = ddr_read_range(dev, addr, values, count);
+        }
+        if (ret) {
+            fprintf(stderr, "%s: %s\n", argv[1], ddr_strerror(ret));
+            free(values);
+            ddr_close(dev);
+            return 1;
+        }
+
+        if (write) {
+            printf("Wrote %zu values to 0x%lx (only if previously 0)\n", count, addr);
+        } else {
+            printf("Reading %zu values from 0x%lx:\n", count, addr);
+            for (i = 0; i < (int)count; i++)
+                printf("  [0x%lx] = 0x%x\n", addr + i*4, values[i]);
+        }
+        free(values);
+
+    } else if (strcmp(argv[1], "readn") == 0 || strcmp(argv[1], "writen") == 0) {
+        if (argc < 4 || (argv[1][0] == 'w' && argc < 5)) usage(argv[0]);
+        ret = run_width(dev, argv[1][0] == 'w', argc - 2, argv + 2);
+        ddr_close(dev);
+        return ret;
+
+    } else if (strcmp(argv[1], "dump") == 0) {
+        if (argc < 5) usage(argv[0]);
+        addr = strtoul(argv[2], NULL, 0);
+        count = strtoul(argv[3], NULL, 0);
+        if (check_alignment(addr) < 0 || count == 0) { ddr_close(dev); return 1; }
+
+        if (dump_words(dev, addr, count, argv[4]) < 0) { ddr_close(dev); return 1; }
+        printf("Dumped %zu values from 0x%lx to %s\n", count, addr, argv[4]);
+
+    } else if (strcmp(argv[1], "load") == 0) {
+        if (argc < 4) usage(argv[0]);
+        addr = strtoul(argv[2], NULL, 0);
+        if (check_alignment(addr) < 0) { ddr_close(dev); return 1; }
+
+        if (load_words(dev, addr, argv[3], &count) < 0) { ddr_close(dev); return 1; }
+        printf("Loaded %zu values from %s to 0x%lx (only where previously 0)\n",
+               count, argv[3], addr);
 
-        if (ioctl(fd, DDR_WRITE, &rw_args) < 0) {
-            perror("ioctl DDR_WRITE");
-            close(fd);
+    } else if (strcmp(argv[1], "poll") == 0) {
+        uint32_t mask, expected, timeout_us = 1000000, interval_us = 100;
+        uint64_t elapsed_ns = 0;
+
+        if (argc < 5) usage(argv[0]);
+        addr = strtoul(argv[2], NULL, 0);
+        mask = strtoul(argv[3], NULL, 0);
+        expected = strtoul(argv[4], NULL, 0);
+        if (argc > 5) timeout_us = strtoul(argv[5], NULL, 0);
+        if (argc > 6) interval_us = strtoul(argv[6], NULL, 0);
+        if (check_alignment(addr) < 0) { ddr_close(dev); return 1; }
+
+        ret = ddr_poll(dev, addr, mask, expected, timeout_us, interval_us, &value, &elapsed_ns);
+        if (ret && ret != DDR_ERR_TIMEOUT) {
+            fprintf(stderr, "poll: %s\n", ddr_strerror(ret));
+            ddr_close(dev);
             return 1;
         }
-        printf("Wrote 0x%x to 0x%lx (only if previously 0)\n", rw_args.value, rw_args.addr);
+        printf("%s: value at 0x%lx = 0x%x after %llu us\n",
+               ret ? "Timed out" : "Condition met", addr, value,
+               (unsigned long long)(elapsed_ns / 1000));
+        if (ret) { ddr_close(dev); return 1; }
 
-    } else if (strcmp(argv[1], "read_range") == 0) {
+    } else if (strcmp(argv[1], "watch") == 0) {
         if (argc < 4) usage(argv[0]);
-        range_args.addr = strtoul(argv[2], NULL, 0);
-        range_args.count = atoi(argv[3]);
-        if (range_args.count > 256) range_args.count = 256;
-        if (check_alignment(range_args.addr) < 0) { close(fd); return 1; }
-
-        if (ioctl(fd, DDR_READ_RANGE, &range_args) < 0) {
-            perror("ioctl DDR_READ_RANGE");
-            close(fd);
+        if (run_watch(dev, strtoul(argv[2], NULL, 0), argv + 3, argc - 3) < 0) {
+            ddr_close(dev);
             return 1;
         }
-        printf("Reading %d values from 0x%lx:\n", range_args.count, range_args.addr);
-        for (i = 0; i < range_args.count; i++)
-            printf("  [0x%lx] = 0x%x\n", range_args.addr + i*4, range_args.values[i]);
 
-    } else if (strcmp(argv[1], "write_range") == 0) {
+    } else if (strcmp(argv[1], "sample") == 0) {
+        if (argc < 6) usage(argv[0]);
+        if (run_sample(strtoul(argv[2], NULL, 0), strtoull(argv[3], NULL, 0), argv[4], argv[5],
+                       argc > 6 ? atoi(argv[6]) : -1) < 0) {
+            ddr_close(dev);
+            return 1;
+        }
+
+
+    } else if (strcmp(argv[1], "memtest") == 0) {
         if (argc < 4) usage(argv[0]);
-        range_args.addr = strtoul(argv[2], NULL, 0);
-        range_args.count = argc - 3;
-        if (range_args.count > 256) range_args.count = 256;
-        if (check_alignment(range_args.addr) < 0) { close(fd); return 1; }
+        if (run_memtest(dev, argc - 2, argv + 2) < 0) { ddr_close(dev); return 1; }
 
-        for (i = 0; i < range_args.count; i++)
-            range_args.values[i] = strtoul(argv[3 + i], NULL, 0);
+    } else if (strcmp(argv[1], "stress") == 0) {
+        if (argc < 6) usage(argv[0]);
+        addr = strtoul(argv[2], NULL, 0);
+        if (check_alignment(addr) < 0) { ddr_close(dev); return 1; }
 
-        if (ioctl(fd, DDR_WRITE_RANGE, &range_args) < 0) {
-            perror("ioctl DDR_WRITE_RANGE");
-            close(fd);
+        if (run_stress(addr, strtoul(argv[3], NULL, 0), atoi(argv[4]), atoi(argv[5])) < 0) {
+            ddr_close(dev);
             return 1;
         }
-        printf("Wrote %d values to 0x%lx (only if previously 0)\n",
-               range_args.count, range_args.addr);
+
+    } else if (strcmp(argv[1], "batch") == 0) {
+        if (run_batch(dev, argv[2]) < 0) { ddr_close(dev); return 1; }
 
     } else {
         usage(argv[0]);
     }
 
-    close(fd);
+    ddr_close(dev);
     return 0;
 }
@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Tracepoints for the ddr module, under events/ddr/ in tracefs.
+ *
+ * ddr_op fires once per operation (an ioctl, one SG segment or one batch
+ * op) with its duration; ddr_word fires for every word moved by the
+ * read/write paths. Both cost a patched-out branch while disabled.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ddr
+
+#if !defined(_DDR_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _DDR_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/ktime.h>
+
+#ifndef _DDR_TRACE_OPS
+#define _DDR_TRACE_OPS
+enum ddr_trace_op {
+    DDR_TR_READ = 1,
+    DDR_TR_WRITE,
+    DDR_TR_READ_RANGE,
+    DDR_TR_WRITE_RANGE,
+    DDR_TR_READ_SG,
+    DDR_TR_WRITE_SG,
+    DDR_TR_POLL,
+    DDR_TR_BATCH_READ = 16,     // + enum ddr_batch_opcode
+    DDR_TR_BATCH_WRITE,
+    DDR_TR_BATCH_CLEAR,
+    DDR_TR_BATCH_POLL,
+};
+#endif
+
+TRACE_DEFINE_ENUM(DDR_TR_READ);
+TRACE_DEFINE_ENUM(DDR_TR_WRITE);
+TRACE_DEFINE_ENUM(DDR_TR_READ_RANGE);
+TRACE_DEFINE_ENUM(DDR_TR_WRITE_RANGE);
+TRACE_DEFINE_ENUM(DDR_TR_READ_SG);
+TRACE_DEFINE_ENUM(DDR_TR_WRITE_SG);
+TRACE_DEFINE_ENUM(DDR_TR_POLL);
+TRACE_DEFINE_ENUM(DDR_TR_BATCH_READ);
+TRACE_DEFINE_ENUM(DDR_TR_BATCH_WRITE);
+TRACE_DEFINE_ENUM(DDR_TR_BATCH_CLEAR);
+TRACE_DEFINE_ENUM(DDR_TR_BATCH_POLL);
+
+#define show_ddr_op(op)                                 \
+    __print_symbolic(op,                                \
+        { DDR_TR_READ,        "read" },                 \
+        { DDR_TR_WRITE,       "write" },                \
+        { DDR_TR_READ_RANGE,  "read_range" },           \
+        { DDR_TR_WRITE_RANGE, "write_range" },          \
+        { DDR_TR_READ_SG,     "read_sg" },              \
+        { DDR_TR_WRITE_SG,    "write_sg" },             \
+        { DDR_TR_POLL,        "poll" },                 \
+        { DDR_TR_BATCH_READ,  "batch_read" },           \
+        { DDR_TR_BATCH_WRITE, "batch_write" },          \
+        { DDR_TR_BATCH_CLEAR, "batch_clear" },          \
+        { DDR_TR_BATCH_POLL,  "batch_poll" })
+
+/*
+ * value is the first element read or written (the final value for
+ * polls); count elements of width bytes each start at addr.
+ * start_ns is ktime_get_ns() when the op began, 0 if tracing was off
+ * then; the duration is taken here so it costs nothing when disabled.
+ */
+TRACE_EVENT(ddr_op,
+    TP_PROTO(unsigned int op, u64 addr, u64 value, u32 count, u32 width, int result,
+             u64 start_ns),
+    TP_ARGS(op, addr, value, count, width, result, start_ns),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, op)
+        __field(u64, addr)
+        __field(u64, value)
+        __field(u32, count)
+        __field(u32, width)
+        __field(int, result)
+        __field(u64, duration_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->op = op;
+        __entry->addr = addr;
+        __entry->value = value;
+        __entry->count = count;
+        __entry->width = width;
+        __entry->result = result;
+        __entry->duration_ns = start_ns ? ktime_get_ns() - start_ns : 0;
+    ),
+
+    TP_printk("op=%s addr=0x%llx value=0x%llx count=%u width=%u result=%d ns=%llu",
+              show_ddr_op(__entry->op), __entry->addr, __entry->value,
+              __entry->count, __entry->width, __entry->result, __entry->duration_ns)
+);
+
+/* done is false for a write skipped because the element was not 0. */
+TRACE_EVENT(ddr_word,
+    TP_PROTO(u64 addr, u64 value, bool write, bool done),
+    TP_ARGS(addr, value, write, done),
+
+    TP_STRUCT__entry(
+        __field(u64, addr)
+        __field(u64, value)
+        __field(bool, write)
+        __field(bool, done)
+    ),
+
+    TP_fast_assign(
+        __entry->addr = addr;
+        __entry->value = value;
+        __entry->write = write;
+        __entry->done = done;
+    ),
+
+    TP_printk("dir=%s addr=0x%llx value=0x%llx",
+              !__entry->write ? "read" : __entry->done ? "write" : "skip",
+              __entry->addr, __entry->value)
+);
+
+#endif // _DDR_TRACE_H
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ddr_trace
+#include <trace/define_trace.h>
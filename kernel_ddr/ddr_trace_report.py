@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Per-address access report from a ddr tracepoint capture.
+
+Capture with, for example:
+    echo 1 > /sys/kernel/tracing/events/ddr/enable
+    cat /sys/kernel/tracing/trace_pipe > ddr.trace
+or `trace-cmd record -e ddr` + `trace-cmd report > ddr.trace`, or
+`perf record -e 'ddr:*'` + `perf script > ddr.trace`, then:
+    ./ddr_trace_report.py ddr.trace [--top 20] [--page] [--csv]
+
+ddr_word events give exact per-word counts. Without them the element
+addresses are expanded from the addr/count/width of each ddr_op event
+(width 4 for captures taken before the field existed).
+"""
+import argparse
+import re
+import sys
+from collections import defaultdict
+
+EVENT_RE = re.compile(r"\s(\d+\.\d+):\s+ddr_(op|word):\s+(.*)$")
+FIELD_RE = re.compile(r"(\w+)=(\S+)")
+
+READ_OPS = {"read", "read_range", "read_sg", "batch_read", "poll", "batch_poll"}
+WRITE_OPS = {"write", "write_range", "write_sg", "batch_write", "batch_clear"}
+
+
+def parse(lines):
+    for line in lines:
+        m = EVENT_RE.search(line)
+        if not m:
+            continue
+        fields = dict(FIELD_RE.findall(m.group(3)))
+        yield float(m.group(1)), m.group(2), fields
+
+
+def new_entry():
+    return {"reads": 0, "writes": 0, "skipped": 0, "first": None, "last": None}
+
+
+def touch(entry, ts):
+    if entry["first"] is None:
+        entry["first"] = ts
+    entry["last"] = ts
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("trace", nargs="?", help="trace text (default: stdin)")
+    ap.add_argument("--top", type=int, default=20, help="addresses to list (0 = all)")
+    ap.add_argument("--page", action="store_true", help="aggregate by 4 KiB page")
+    ap.add_argument("--csv", action="store_true", help="CSV output for the address table")
+    args = ap.parse_args()
+
+    src = open(args.trace) if args.trace else sys.stdin
+    events = list(parse(src))
+    if src is not sys.stdin:
+        src.close()
+    if not events:
+        sys.exit("no ddr_op/ddr_word events found")
+
+    have_words = any(kind == "word" for _, kind, _ in events)
+    gran = 0x1000 if args.page else 4
+    addrs = defaultdict(new_entry)
+    ops = defaultdict(lambda: {"count": 0, "errors": 0, "words": 0, "ns": 0, "max_ns": 0})
+
+    for ts, kind, f in events:
+        if kind == "word":
+            e = addrs[int(f["addr"], 16) // gran * gran]
+            touch(e, ts)
+            if f["dir"] == "read":
+                e["reads"] += 1
+            elif f["dir"] == "write":
+                e["writes"] += 1
+            else:
+                e["skipped"] += 1
+            continue
+
+        op = f["op"]
+        ns = int(f.get("ns", 0))
+        count = int(f.get("count", 1))
+        s = ops[op]
+        s["count"] += 1
+        s["words"] += count
+        s["ns"] += ns
+        s["max_ns"] = max(s["max_ns"], ns)
+        if int(f.get("result", 0)) < 0:
+            s["errors"] += 1
+
+        if not have_words and op not in ("poll", "batch_poll"):
+            base = int(f["addr"], 16)
+            width = int(f.get("width", 4))
+            key = "reads" if op in READ_OPS else "writes" if op in WRITE_OPS else None
+            if key:
+                for i in range(count):
+                    e = addrs[(base + width * i) // gran * gran]
+                    touch(e, ts)
+                    e[key] += 1
+
+    span = events[-1][0] - events[0][0]
+    print(f"{len(events)} events over {span:.6f} s"
+          + ("" if have_words else " (no ddr_word events: expanded from ddr_op ranges)"))
+
+    if ops:
+        print(f"\n{'op':<12} {'count':>10} {'errors':>8} {'words':>12} {'avg_ns':>10} {'max_ns':>10}")
+        for op, s in sorted(ops.items(), key=lambda kv: -kv[1]["count"]):
+            print(f"{op:<12} {s['count']:>10} {s['errors']:>8} {s['words']:>12} "
+                  f"{s['ns'] // max(s['count'], 1):>10} {s['max_ns']:>10}")
+
+    rows = sorted(addrs.items(),
+                  key=lambda kv: -(kv[1]["reads"] + kv[1]["writes"] + kv[1]["skipped"]))
+    if args.top:
+        rows = rows[:args.top]
+    label = "page" if args.page else "addr"
+
+    if args.csv:
+        print(f"\n{label},reads,writes,skipped,total,first,last")
+        for a, e in rows:
+            total = e["reads"] + e["writes"] + e["skipped"]
+            print(f"0x{a:x},{e['reads']},{e['writes']},{e['skipped']},{total},"
+                  f"{e['first']:.6f},{e['last']:.6f}")
+        return
+
+    print(f"\n{label:<18} {'reads':>10} {'writes':>10} {'skipped':>8} {'total':>10} {'per_s':>10}")
+    for a, e in rows:
+        total = e["reads"] + e["writes"] + e["skipped"]
+        rate = total / span if span > 0 else 0
+        print(f"0x{a:<16x} {e['reads']:>10} {e['writes']:>10} {e['skipped']:>8} "
+              f"{total:>10} {rate:>10.1f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * C++ wrapper around libddr: owns the device for its lifetime and reports
+ * failures as DdrError values.
+ */
+#ifndef DDRDEVICE_H
+#define DDRDEVICE_H
+
+#include <cstdint>
+#include <vector>
+#include "libddr.h"
+
+enum class DdrError {
+    Ok       = DDR_OK,
+    Open     = DDR_ERR_OPEN,
+    Align    = DDR_ERR_ALIGN,
+    Invalid  = DDR_ERR_INVALID,
+    Exists   = DDR_ERR_EXISTS,
+    NoMem    = DDR_ERR_NOMEM,
+    Fault    = DDR_ERR_FAULT,
+    Timeout  = DDR_ERR_TIMEOUT,
+    Perm     = DDR_ERR_PERM,
+    Io       = DDR_ERR_IO,
+};
+
+class DdrDevice {
+public:
+    explicit DdrDevice(const char *path = DDR_DEVICE_PATH)
+        : dev_(nullptr), openError_(toError(ddr_open(path, &dev_))) {}
+    ~DdrDevice() { ddr_close(dev_); }
+
+    DdrDevice(const DdrDevice &) = delete;
+    DdrDevice &operator=(const DdrDevice &) = delete;
+    DdrDevice(DdrDevice &&other) noexcept
+        : dev_(other.dev_), openError_(other.openError_) { other.dev_ = nullptr; }
+    DdrDevice &operator=(DdrDevice &&other) noexcept {
+        if (this != &other) {
+            ddr_close(dev_);
+            dev_ = other.dev_;
+            openError_ = other.openError_;
+            other.dev_ = nullptr;
+        }
+        return *this;
+    }
+
+    bool isOpen() const { return dev_ != nullptr; }
+    DdrError openError() const { return openError_; }
+    unsigned int caps() const { return dev_ ? ddr_caps(dev_) : 0; }
+    int lastErrno() const { return dev_ ? ddr_last_errno(dev_) : 0; }
+
+    DdrError read(unsigned long addr, uint32_t &value) {
+        return dev_ ? toError(ddr_read(dev_, addr, &value)) : DdrError::Open;
+    }
+    DdrError write(unsigned long addr, uint32_t value) {
+        return dev_ ? toError(ddr_write(dev_, addr, value)) : DdrError::Open;
+    }
+    DdrError readRange(unsigned long addr, std::vector<uint32_t> &values, size_t count) {
+        values.resize(count);
+        return dev_ ? toError(ddr_read_range(dev_, addr, values.data(), count)) : DdrError::Open;
+    }
+    DdrError writeRange(unsigned long addr, const std::vector<uint32_t> &values) {
+        return dev_ ? toError(ddr_write_range(dev_, addr, values.data(), values.size()))
+                    : DdrError::Open;
+    }
+    // 1, 2, 4 or 8-byte single accesses (see ddr_read_width)
+    DdrError readWidth(unsigned long addr, unsigned int width, uint64_t &value) {
+        return dev_ ? toError(ddr_read_width(dev_, addr, width, &value)) : DdrError::Open;
+    }
+    DdrError writeWidth(unsigned long addr, unsigned int width, uint64_t value) {
+        return dev_ ? toError(ddr_write_width(dev_, addr, width, value)) : DdrError::Open;
+    }
+    DdrError batch(std::vector<ddr_batch_op> &ops, int &failed) {
+        return dev_ ? toError(ddr_batch(dev_, ops.data(), ops.size(), &failed)) : DdrError::Open;
+    }
+    DdrError poll(unsigned long addr, uint32_t mask, uint32_t expected, uint32_t timeoutUs,
+                  uint32_t intervalUs, uint32_t &value, uint64_t &elapsedNs) {
+        return dev_ ? toError(ddr_poll(dev_, addr, mask, expected, timeoutUs, intervalUs,
+                                       &value, &elapsedNs))
+                    : DdrError::Open;
+    }
+
+    // Watchlist; fd() becomes readable when a watched value changes
+    DdrError watch(const std::vector<ddr_watch_entry> &entries, uint32_t periodUs,
+                   int eventfd = -1) {
+        return dev_ ? toError(ddr_watch(dev_, entries.data(), entries.size(), periodUs, eventfd))
+                    : DdrError::Open;
+    }
+    // Returns the number of events read (0 on timeout) or a negative DdrError value
+    int readEvents(std::vector<ddr_watch_event> &events, unsigned int max, int timeoutMs) {
+        events.resize(max);
+        int n = dev_ ? ddr_watch_read(dev_, events.data(), max, timeoutMs)
+                     : static_cast<int>(DdrError::Open);
+        events.resize(n > 0 ? n : 0);
+        return n;
+    }
+    int fd() const { return dev_ ? ddr_fd(dev_) : -1; }
+
+    // Deferred reads, coalesced into range reads by flush()
+    DdrError queueRead(unsigned long addr, uint32_t *out) {
+        return dev_ ? toError(ddr_queue_read(dev_, addr, out)) : DdrError::Open;
+    }
+    DdrError flush() {
+        return dev_ ? toError(ddr_flush(dev_)) : DdrError::Open;
+    }
+
+    static const char *errorString(DdrError e) { return ddr_strerror(static_cast<int>(e)); }
+
+private:
+    static DdrError toError(int status) { return static_cast<DdrError>(status); }
+
+    ddr_dev *dev_;
+    DdrError openError_;
+};
+
+#endif // DDRDEVICE_H
@@ -0,0 +1,297 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * io_uring front end for /dev/ddr, talking to the kernel through the raw
+ * io_uring syscalls so the library keeps no dependency beyond libc.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+#include "libddr.h"
+
+struct ddr_async {
+    ddr_dev *dev;
+    int ring_fd;
+    int event_fd;
+    int last_errno;
+
+    // submission queue
+    void *sq_ptr;
+    size_t sq_len;
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned int sq_entries;
+    unsigned int sq_local_tail;     // tail including unsubmitted entries
+    unsigned int to_submit;
+
+    // completion queue, shares sq_ptr when IORING_FEAT_SINGLE_MMAP
+    void *cq_ptr;
+    size_t cq_len;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                              unsigned int flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr);
+}
+
+static int fail(ddr_async *as, int err)
+{
+    as->last_errno = err;
+    return ddr_status_from_errno(err);
+}
+
+static int map_rings(ddr_async *as, const struct io_uring_params *p)
+{
+    as->sq_len = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+    as->cq_len = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if ((p->features & IORING_FEAT_SINGLE_MMAP) && as->cq_len > as->sq_len)
+        as->sq_len = as->cq_len;
+
+    as->sq_ptr = mmap(NULL, as->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      as->ring_fd, IORING_OFF_SQ_RING);
+    if (as->sq_ptr == MAP_FAILED) {
+        as->sq_ptr = NULL;
+        return -1;
+    }
+
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        as->cq_ptr = as->sq_ptr;
+    } else {
+        as->cq_ptr = mmap(NULL, as->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          as->ring_fd, IORING_OFF_CQ_RING);
+        if (as->cq_ptr == MAP_FAILED) {
+            as->cq_ptr = NULL;
+            return -1;
+        }
+    }
+
+    as->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+    as->sqes = mmap(NULL, as->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    as->ring_fd, IORING_OFF_SQES);
+    if (as->sqes == MAP_FAILED) {
+        as->sqes = NULL;
+        return -1;
+    }
+
+    as->sq_head  = (unsigned int *)((char *)as->sq_ptr + p->sq_off.head);
+    as->sq_tail  = (unsigned int *)((char *)as->sq_ptr + p->sq_off.tail);
+    as->sq_mask  = (unsigned int *)((char *)as->sq_ptr + p->sq_off.ring_mask);
+    as->sq_array = (unsigned int *)((char *)as->sq_ptr + p->sq_off.array);
+    as->sq_entries = p->sq_entries;
+    as->sq_local_tail = *as->sq_tail;
+
+    as->cq_head = (unsigned int *)((char *)as->cq_ptr + p->cq_off.head);
+    as->cq_tail = (unsigned int *)((char *)as->cq_ptr + p->cq_off.tail);
+    as->cq_mask = (unsigned int *)((char *)as->cq_ptr + p->cq_off.ring_mask);
+    as->cqes    = (struct io_uring_cqe *)((char *)as->cq_ptr + p->cq_off.cqes);
+    return 0;
+}
+
+int ddr_async_open(ddr_dev *dev, unsigned int depth, ddr_async **out)
+{
+    struct io_uring_params p;
+    struct ddr_async_cqe cqe;
+    struct ddr_batch_args probe = { .ops = 0, .count = 0, .failed = -1 };
+    ddr_async *as;
+    int ret;
+
+    *out = NULL;
+    if (!depth)
+        return DDR_ERR_INVALID;
+
+    as = calloc(1, sizeof(*as));
+    if (!as)
+        return DDR_ERR_NOMEM;
+    as->dev = dev;
+    as->event_fd = -1;
+
+    memset(&p, 0, sizeof(p));
+    as->ring_fd = sys_io_uring_setup(depth, &p);
+    if (as->ring_fd < 0) {
+        ret = errno == ENOSYS ? DDR_ERR_INVALID : ddr_status_from_errno(errno);
+        free(as);
+        return ret;
+    }
+
+    if (map_rings(as, &p) < 0) {
+        ddr_async_close(as);
+        return DDR_ERR_NOMEM;
+    }
+
+    // An empty batch tells us whether the module implements uring_cmd
+    ret = ddr_async_batch(as, &probe, 0);
+    if (ret == DDR_OK && ddr_async_submit(as) < 0)
+        ret = DDR_ERR_IO;
+    if (ret == DDR_OK && ddr_async_reap(as, &cqe, 1, 1) != 1)
+        ret = DDR_ERR_IO;
+    if (ret == DDR_OK && cqe.status != DDR_OK)
+        ret = cqe.err == EOPNOTSUPP ? DDR_ERR_INVALID : cqe.status;
+    if (ret != DDR_OK) {
+        ddr_async_close(as);
+        return ret;
+    }
+
+    *out = as;
+    return DDR_OK;
+}
+
+void ddr_async_close(ddr_async *as)
+{
+    if (!as)
+        return;
+    if (as->sqes)
+        munmap(as->sqes, as->sqes_len);
+    if (as->cq_ptr && as->cq_ptr != as->sq_ptr)
+        munmap(as->cq_ptr, as->cq_len);
+    if (as->sq_ptr)
+        munmap(as->sq_ptr, as->sq_len);
+    if (as->event_fd >= 0)
+        close(as->event_fd);
+    close(as->ring_fd);
+    free(as);
+}
+
+int ddr_async_eventfd(ddr_async *as)
+{
+    int efd;
+
+    if (as->event_fd >= 0)
+        return as->event_fd;
+
+    efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (efd < 0)
+        return fail(as, errno);
+    if (sys_io_uring_register(as->ring_fd, IORING_REGISTER_EVENTFD, &efd, 1) < 0) {
+        int err = errno;
+
+        close(efd);
+        return fail(as, err);
+    }
+    as->event_fd = efd;
+    return efd;
+}
+
+int ddr_async_cmd(ddr_async *as, unsigned int cmd, void *arg, uint64_t user_data)
+{
+    struct ddr_uring_cmd *payload;
+    struct io_uring_sqe *sqe;
+    unsigned int idx;
+
+    // Ring full: hand what we have to the kernel to make room
+    if (as->sq_local_tail - __atomic_load_n(as->sq_head, __ATOMIC_ACQUIRE) >= as->sq_entries) {
+        int ret = ddr_async_submit(as);
+
+        if (ret < 0)
+            return ret;
+        if (as->sq_local_tail - __atomic_load_n(as->sq_head, __ATOMIC_ACQUIRE) >= as->sq_entries)
+            return fail(as, EBUSY);
+    }
+
+    idx = as->sq_local_tail & *as->sq_mask;
+    sqe = &as->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_URING_CMD;
+    sqe->fd = ddr_fd(as->dev);
+    sqe->cmd_op = cmd;
+    sqe->user_data = user_data;
+    payload = (struct ddr_uring_cmd *)sqe->cmd;
+    payload->arg = (uintptr_t)arg;
+
+    as->sq_array[idx] = idx;
+    as->sq_local_tail++;
+    as->to_submit++;
+    return DDR_OK;
+}
+
+int ddr_async_read(ddr_async *as, struct ddr_rw_args *args, uint64_t user_data)
+{
+    if (args->addr % 4)
+        return DDR_ERR_ALIGN;
+    return ddr_async_cmd(as, DDR_READ, args, user_data);
+}
+
+int ddr_async_write(ddr_async *as, struct ddr_rw_args *args, uint64_t user_data)
+{
+    if (args->addr % 4)
+        return DDR_ERR_ALIGN;
+    return ddr_async_cmd(as, DDR_WRITE, args, user_data);
+}
+
+int ddr_async_xfer(ddr_async *as, struct ddr_xfer_args *args, int write, uint64_t user_data)
+{
+    if (!(ddr_caps(as->dev) & DDR_CAP_SG))
+        return DDR_ERR_INVALID;
+    return ddr_async_cmd(as, write ? DDR_WRITE_SG : DDR_READ_SG, args, user_data);
+}
+
+int ddr_async_batch(ddr_async *as, struct ddr_batch_args *args, uint64_t user_data)
+{
+    if (!(ddr_caps(as->dev) & DDR_CAP_BATCH))
+        return DDR_ERR_INVALID;
+    return ddr_async_cmd(as, DDR_BATCH, args, user_data);
+}
+
+int ddr_async_submit(ddr_async *as)
+{
+    int submitted;
+
+    if (!as->to_submit)
+        return 0;
+
+    // Publish the new tail only after the SQEs are fully written
+    __atomic_store_n(as->sq_tail, as->sq_local_tail, __ATOMIC_RELEASE);
+
+    submitted = sys_io_uring_enter(as->ring_fd, as->to_submit, 0, 0);
+    if (submitted < 0)
+        return fail(as, errno);
+    as->to_submit -= submitted;
+    return submitted;
+}
+
+int ddr_async_reap(ddr_async *as, struct ddr_async_cqe *cqes, unsigned int max,
+                   unsigned int min_wait)
+{
+    unsigned int head, tail, n = 0;
+
+    for (;;) {
+        head = *as->cq_head;
+        tail = __atomic_load_n(as->cq_tail, __ATOMIC_ACQUIRE);
+
+        while (head != tail && n < max) {
+            const struct io_uring_cqe *cqe = &as->cqes[head & *as->cq_mask];
+
+            cqes[n].user_data = cqe->user_data;
+            cqes[n].err = cqe->res < 0 ? -cqe->res : 0;
+            cqes[n].status = ddr_status_from_errno(cqes[n].err);
+            head++;
+            n++;
+        }
+        __atomic_store_n(as->cq_head, head, __ATOMIC_RELEASE);
+
+        if (n >= min_wait || n >= max)
+            return n;
+
+        if (sys_io_uring_enter(as->ring_fd, 0, min_wait - n, IORING_ENTER_GETEVENTS) < 0 &&
+            errno != EINTR)
+            return fail(as, errno);
+    }
+}
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Consumer side of the /dev/ddr_sample ring: the kernel publishes head
+ * with release semantics after filling a slot, we publish tail the same
+ * way after copying one out.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "libddr.h"
+
+struct ddr_sampler {
+    int fd;
+    struct ddr_sample_ring *ring;
+    size_t ring_size;
+    const unsigned char *data;
+    uint32_t slots;
+    uint32_t slot_size;
+};
+
+int ddr_sample_open(const char *path, const uint64_t *addrs, unsigned int nregs,
+                    uint32_t period_ns, uint32_t slots, int cpu, ddr_sampler **out)
+{
+    struct ddr_sample_args args;
+    ddr_sampler *s;
+    void *ring;
+    int ret;
+
+    *out = NULL;
+    if (!nregs)
+        return DDR_ERR_INVALID;
+
+    s = calloc(1, sizeof(*s));
+    if (!s)
+        return DDR_ERR_NOMEM;
+
+    s->fd = open(path ? path : DDR_SAMPLE_PATH, O_RDWR);
+    if (s->fd < 0) {
+        free(s);
+        return DDR_ERR_OPEN;
+    }
+
+    memset(&args, 0, sizeof(args));
+    args.addrs = (uintptr_t)addrs;
+    args.nregs = nregs;
+    args.period_ns = period_ns;
+    args.slots = slots;
+    args.cpu = cpu;
+    if (ioctl(s->fd, DDR_SAMPLE, &args) < 0) {
+        ret = ddr_status_from_errno(errno);
+        close(s->fd);
+        free(s);
+        return ret;
+    }
+
+    ring = mmap(NULL, args.ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+    if (ring == MAP_FAILED) {
+        ret = ddr_status_from_errno(errno);
+        close(s->fd);
+        free(s);
+        return ret;
+    }
+
+    s->ring = ring;
+    s->ring_size = args.ring_size;
+    s->slots = s->ring->slots;
+    s->slot_size = s->ring->slot_size;
+    s->data = (const unsigned char *)ring + s->ring->data_offset;
+    *out = s;
+    return DDR_OK;
+}
+
+void ddr_sample_close(ddr_sampler *s)
+{
+    if (!s)
+        return;
+    // closing the fd stops sampling once the mapping is gone
+    munmap(s->ring, s->ring_size);
+    close(s->fd);
+    free(s);
+}
+
+size_t ddr_sample_slot_size(const ddr_sampler *s)
+{
+    return s->slot_size;
+}
+
+int ddr_sample_read(ddr_sampler *s, void *buf, unsigned int max)
+{
+    uint32_t head = __atomic_load_n(&s->ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = s->ring->tail;
+    unsigned int n = 0;
+
+    while (tail != head && n < max) {
+        memcpy((unsigned char *)buf + (size_t)n * s->slot_size,
+               s->data + (size_t)(tail & (s->slots - 1)) * s->slot_size, s->slot_size);
+        tail++;
+        n++;
+    }
+    __atomic_store_n(&s->ring->tail, tail, __ATOMIC_RELEASE);
+    return n;
+}
+
+void ddr_sample_stats(const ddr_sampler *s, uint64_t *overruns, uint64_t *missed)
+{
+    if (overruns)
+        *overruns = __atomic_load_n(&s->ring->overruns, __ATOMIC_RELAXED);
+    if (missed)
+        *missed = __atomic_load_n(&s->ring->missed, __ATOMIC_RELAXED);
+}
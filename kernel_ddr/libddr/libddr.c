@@ -0,0 +1,694 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <poll.h>
+
+#include "libddr.h"
+
+#define DDR_PARAM_DIR "/sys/module/ddr/parameters/"
+
+// Fallback poll timeout when DDR_BATCH has to be emulated
+#define DDR_EMUL_POLL_TIMEOUT_US 10000
+
+struct ddr_queued {
+    unsigned long addr;
+    uint32_t *out;
+};
+
+struct ddr_dev {
+    int fd;
+    unsigned int caps;
+    int last_errno;
+
+    // mmap window, valid when caps & DDR_CAP_MMAP
+    unsigned long win_base;
+    size_t win_size;
+    volatile uint32_t *win;
+
+    // deferred reads for ddr_flush()
+    struct ddr_queued *queue;
+    size_t queued;
+    size_t queue_cap;
+};
+
+static int read_param(const char *name, unsigned long *value)
+{
+    char path[128];
+    FILE *f;
+    int ok;
+
+    snprintf(path, sizeof(path), DDR_PARAM_DIR "%s", name);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    ok = fscanf(f, "%lu", value) == 1;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+int ddr_status_from_errno(int err)
+{
+    switch (err) {
+    case 0:         return DDR_OK;
+    case EINVAL:    return DDR_ERR_INVALID;
+    case EEXIST:    return DDR_ERR_EXISTS;
+    case ENOMEM:    return DDR_ERR_NOMEM;
+    case EFAULT:    return DDR_ERR_FAULT;
+    case ETIMEDOUT: return DDR_ERR_TIMEOUT;
+    case EOPNOTSUPP: return DDR_ERR_INVALID;
+    case EPERM:
+    case EACCES:    return DDR_ERR_PERM;
+    default:        return DDR_ERR_IO;
+    }
+}
+
+static int ddr_ioctl(ddr_dev *dev, unsigned long cmd, void *arg)
+{
+    if (ioctl(dev->fd, cmd, arg) < 0) {
+        dev->last_errno = errno;
+        return ddr_status_from_errno(errno);
+    }
+    return DDR_OK;
+}
+
+static int in_window(const ddr_dev *dev, unsigned long addr, size_t len)
+{
+    return (dev->caps & DDR_CAP_MMAP) && addr >= dev->win_base &&
+           len <= dev->win_size && addr - dev->win_base <= dev->win_size - len;
+}
+
+int ddr_open(const char *path, ddr_dev **out)
+{
+    struct ddr_xfer_args xfer = {0};
+    struct ddr_batch_args batch = {0};
+    struct ddr_poll_args poll = {0};
+    struct ddr_watch_args watch = { .eventfd = -1 };
+    struct ddr_io io = { .size = sizeof(io), .buf = (uintptr_t)&io };
+    struct ddr_io wio = { .size = sizeof(wio), .buf = (uintptr_t)&wio, .width = 1 };
+    unsigned long base, size;
+    ddr_dev *dev;
+    void *win;
+
+    *out = NULL;
+    dev = calloc(1, sizeof(*dev));
+    if (!dev)
+        return DDR_ERR_NOMEM;
+
+    dev->fd = open(path ? path : DDR_DEVICE_PATH, O_RDWR);
+    if (dev->fd < 0) {
+        free(dev);
+        return DDR_ERR_OPEN;
+    }
+
+    // zero-length requests succeed on modules that know the command
+    if (ioctl(dev->fd, DDR_READ_SG, &xfer) == 0)
+        dev->caps |= DDR_CAP_SG;
+    if (ioctl(dev->fd, DDR_BATCH, &batch) == 0)
+        dev->caps |= DDR_CAP_BATCH;
+    if (ioctl(dev->fd, DDR_POLL, &poll) == 0)
+        dev->caps |= DDR_CAP_POLL;
+    if (ioctl(dev->fd, DDR_WATCH, &watch) == 0)
+        dev->caps |= DDR_CAP_WATCH;
+    if (ioctl(dev->fd, DDR_IO, &io) == 0)
+        dev->caps |= DDR_CAP_IO;
+    if (ioctl(dev->fd, DDR_IO, &wio) == 0)
+        dev->caps |= DDR_CAP_WIDTH;
+
+    if (read_param("mmap_base", &base) == 0 && read_param("mmap_size", &size) == 0 && size) {
+        win = mmap(NULL, size, PROT_READ, MAP_SHARED, dev->fd, base);
+        if (win != MAP_FAILED) {
+            dev->win = win;
+            dev->win_base = base;
+            dev->win_size = size;
+            dev->caps |= DDR_CAP_MMAP;
+        }
+    }
+
+    *out = dev;
+    return DDR_OK;
+}
+
+void ddr_close(ddr_dev *dev)
+{
+    if (!dev)
+        return;
+    if (dev->caps & DDR_CAP_MMAP)
+        munmap((void *)dev->win, dev->win_size);
+    close(dev->fd);
+    free(dev->queue);
+    free(dev);
+}
+
+unsigned int ddr_caps(const ddr_dev *dev)
+{
+    return dev->caps;
+}
+
+int ddr_fd(const ddr_dev *dev)
+{
+    return dev->fd;
+}
+
+int ddr_last_errno(const ddr_dev *dev)
+{
+    return dev->last_errno;
+}
+
+// Single word through DDR_IO, with the value carried in the struct
+static int ddr_io_word(ddr_dev *dev, uint32_t op, unsigned long addr, uint32_t *value)
+{
+    struct ddr_io io;
+    int ret;
+
+    memset(&io, 0, sizeof(io));
+    io.size = sizeof(io);
+    io.op = op;
+    io.addr = addr;
+    io.value = *value;
+    io.count = 1;
+    ret = ddr_ioctl(dev, DDR_IO, &io);
+    if (ret == DDR_OK)
+        *value = (uint32_t)io.value;
+    return ret;
+}
+
+int ddr_read(ddr_dev *dev, unsigned long addr, uint32_t *value)
+{
+    struct ddr_rw_args rw;
+    int ret;
+
+    if (addr % 4 != 0)
+        return DDR_ERR_ALIGN;
+
+    if (in_window(dev, addr, 4)) {
+        *value = dev->win[(addr - dev->win_base) / 4];
+        return DDR_OK;
+    }
+
+    if (dev->caps & DDR_CAP_IO) {
+        *value = 0;
+        return ddr_io_word(dev, DDR_IO_READ, addr, value);
+    }
+
+    rw.addr = addr;
+    rw.value = 0;
+    ret = ddr_ioctl(dev, DDR_READ, &rw);
+    if (ret == DDR_OK)
+        *value = rw.value;
+    return ret;
+}
+
+int ddr_write(ddr_dev *dev, unsigned long addr, uint32_t value)
+{
+    struct ddr_rw_args rw;
+
+    if (addr % 4 != 0)
+        return DDR_ERR_ALIGN;
+
+    if (dev->caps & DDR_CAP_IO)
+        return ddr_io_word(dev, DDR_IO_WRITE, addr, &value);
+
+    rw.addr = addr;
+    rw.value = value;
+    return ddr_ioctl(dev, DDR_WRITE, &rw);
+}
+
+int ddr_read_range(ddr_dev *dev, unsigned long addr, uint32_t *values, size_t count)
+{
+    struct ddr_range_args range;
+    struct ddr_xfer_args xfer = {0};
+    volatile uint32_t *src;
+    size_t i, n;
+    int ret;
+
+    if (addr % 4 != 0)
+        return DDR_ERR_ALIGN;
+    if (!count)
+        return DDR_OK;
+
+    if (in_window(dev, addr, count * 4)) {
+        src = dev->win + (addr - dev->win_base) / 4;
+        for (i = 0; i < count; i++)
+            values[i] = src[i];
+        return DDR_OK;
+    }
+
+    if (dev->caps & DDR_CAP_SG) {
+        xfer.addr = addr;
+        xfer.count = count;
+        xfer.buf = (uintptr_t)values;
+        return ddr_ioctl(dev, DDR_READ_SG, &xfer);
+    }
+
+    for (i = 0; i < count; i += n) {
+        n = count - i < DDR_RANGE_MAX ? count - i : DDR_RANGE_MAX;
+        range.addr = addr + i * 4;
+        range.count = n;
+        ret = ddr_ioctl(dev, DDR_READ_RANGE, &range);
+        if (ret)
+            return ret;
+        memcpy(values + i, range.values, n * 4);
+    }
+    return DDR_OK;
+}
+
+int ddr_write_range(ddr_dev *dev, unsigned long addr, const uint32_t *values, size_t count)
+{
+    struct ddr_range_args range;
+    struct ddr_xfer_args xfer = {0};
+    size_t i, n;
+    int ret;
+
+    if (addr % 4 != 0)
+        return DDR_ERR_ALIGN;
+    if (!count)
+        return DDR_OK;
+
+    if (dev->caps & DDR_CAP_SG) {
+        xfer.addr = addr;
+        xfer.count = count;
+        xfer.buf = (uintptr_t)values;
+        return ddr_ioctl(dev, DDR_WRITE_SG, &xfer);
+    }
+
+    for (i = 0; i < count; i += n) {
+        n = count - i < DDR_RANGE_MAX ? count - i : DDR_RANGE_MAX;
+        range.addr = addr + i * 4;
+        range.count = n;
+        memcpy(range.values, values + i, n * 4);
+        ret = ddr_ioctl(dev, DDR_WRITE_RANGE, &range);
+        if (ret)
+            return ret;
+    }
+    return DDR_OK;
+}
+
+static int width_ok(unsigned int width)
+{
+    return width == 1 || width == 2 || width == 4 || width == 8;
+}
+
+// One load of the given width from the uncached window
+static uint64_t win_load(const ddr_dev *dev, unsigned long addr, unsigned int width)
+{
+    const volatile char *p = (const volatile char *)dev->win + (addr - dev->win_base);
+
+    switch (width) {
+    case 1:  return *(const volatile uint8_t *)p;
+    case 2:  return *(const volatile uint16_t *)p;
+    case 8:  return *(const volatile uint64_t *)p;
+    default: return *(const volatile uint32_t *)p;
+    }
+}
+
+static int ddr_io_width(ddr_dev *dev, uint32_t op, unsigned long addr, unsigned int width,
+                        uint64_t value, void *buf, size_t count, uint64_t *out)
+{
+    struct ddr_io io;
+    int ret;
+
+    memset(&io, 0, sizeof(io));
+    io.size = sizeof(io);
+    io.op = op;
+    io.addr = addr;
+    io.value = value;
+    io.buf = (uintptr_t)buf;
+    io.count = count;
+    io.width = width;
+    ret = ddr_ioctl(dev, DDR_IO, &io);
+    if (ret == DDR_OK && out)
+        *out = io.value;
+    return ret;
+}
+
+int ddr_read_width(ddr_dev *dev, unsigned long addr, unsigned int width, uint64_t *value)
+{
+    uint32_t word;
+    int ret;
+
+    if (!width_ok(width))
+        return DDR_ERR_INVALID;
+    if (addr % width != 0)
+        return DDR_ERR_ALIGN;
+
+    // 64-bit loads are only single accesses on 64-bit user space
+    if (in_window(dev, addr, width) && (width != 8 || sizeof(long) == 8)) {
+        *value = win_load(dev, addr, width);
+        return DDR_OK;
+    }
+
+    if (dev->caps & DDR_CAP_WIDTH)
+        return ddr_io_width(dev, DDR_IO_READ, addr, width, 0, NULL, 1, value);
+    if (width != 4)
+        return DDR_ERR_INVALID;
+
+    ret = ddr_read(dev, addr, &word);
+    if (ret == DDR_OK)
+        *value = word;
+    return ret;
+}
+
+int ddr_write_width(ddr_dev *dev, unsigned long addr, unsigned int width, uint64_t value)
+{
+    if (!width_ok(width))
+        return DDR_ERR_INVALID;
+    if (addr % width != 0)
+        return DDR_ERR_ALIGN;
+
+    if (dev->caps & DDR_CAP_WIDTH)
+        return ddr_io_width(dev, DDR_IO_WRITE, addr, width, value, NULL, 1, NULL);
+    if (width != 4)
+        return DDR_ERR_INVALID;
+    return ddr_write(dev, addr, (uint32_t)value);
+}
+
+int ddr_read_range_width(ddr_dev *dev, unsigned long addr, unsigned int width, void *buf,
+                         size_t count)
+{
+    size_t i;
+
+    if (!width_ok(width))
+        return DDR_ERR_INVALID;
+    if (addr % width != 0)
+        return DDR_ERR_ALIGN;
+    if (width == 4 && !(dev->caps & DDR_CAP_WIDTH))
+        return ddr_read_range(dev, addr, buf, count);
+    if (!count)
+        return DDR_OK;
+
+    if (in_window(dev, addr, count * width) && (width != 8 || sizeof(long) == 8)) {
+        for (i = 0; i < count; i++) {
+            uint64_t v = win_load(dev, addr + i * width, width);
+
+            switch (width) {
+            case 1:  ((uint8_t *)buf)[i] = v; break;
+            case 2:  ((uint16_t *)buf)[i] = v; break;
+            case 8:  ((uint64_t *)buf)[i] = v; break;
+            default: ((uint32_t *)buf)[i] = v; break;
+            }
+        }
+        return DDR_OK;
+    }
+
+    if (!(dev->caps & DDR_CAP_WIDTH))
+        return DDR_ERR_INVALID;
+    return ddr_io_width(dev, DDR_IO_READ, addr, width, 0, buf, count, NULL);
+}
+
+int ddr_write_range_width(ddr_dev *dev, unsigned long addr, unsigned int width,
+                          const void *buf, size_t count)
+{
+    if (!width_ok(width))
+        return DDR_ERR_INVALID;
+    if (addr % width != 0)
+        return DDR_ERR_ALIGN;
+    if (width == 4 && !(dev->caps & DDR_CAP_WIDTH))
+        return ddr_write_range(dev, addr, buf, count);
+    if (!count)
+        return DDR_OK;
+
+    if (!(dev->caps & DDR_CAP_WIDTH))
+        return DDR_ERR_INVALID;
+    return ddr_io_width(dev, DDR_IO_WRITE, addr, width, 0, (void *)buf, count, NULL);
+}
+
+static long long now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// Turn a library status back into the -errno a batch op reports
+static int op_result(const ddr_dev *dev, int status)
+{
+    if (status == DDR_OK)
+        return 0;
+    if (status == DDR_ERR_ALIGN)
+        return -EINVAL;
+    return -dev->last_errno;
+}
+
+/* One batch op through the single-word paths, for modules without DDR_BATCH. */
+static int batch_op_emulated(ddr_dev *dev, struct ddr_batch_op *op)
+{
+    long long deadline;
+    uint32_t value;
+    int ret;
+
+    switch (op->op) {
+    case DDR_OP_READ:
+        ret = ddr_read(dev, op->addr, &value);
+        if (ret == DDR_OK)
+            op->value = value;
+        return op_result(dev, ret);
+    case DDR_OP_WRITE:
+        // not atomic against other writers, unlike the in-kernel op
+        ret = ddr_read(dev, op->addr, &value);
+        if (ret)
+            return op_result(dev, ret);
+        if (value != 0)
+            return -EEXIST;
+        return op_result(dev, ddr_write(dev, op->addr, op->value));
+    case DDR_OP_POLL:
+        if (!op->mask || (op->value & ~op->mask))
+            return -EINVAL;
+        deadline = now_us() + DDR_EMUL_POLL_TIMEOUT_US;
+        for (;;) {
+            ret = ddr_read(dev, op->addr, &value);
+            if (ret)
+                return op_result(dev, ret);
+            if ((value & op->mask) == op->value) {
+                op->value = value;
+                return 0;
+            }
+            if (now_us() > deadline) {
+                op->value = value;
+                return -ETIMEDOUT;
+            }
+            usleep(10);
+        }
+    default:
+        // DDR_OP_CLEAR has no single-word equivalent
+        return -EOPNOTSUPP;
+    }
+}
+
+int ddr_batch(ddr_dev *dev, struct ddr_batch_op *ops, unsigned int count, int *failed)
+{
+    struct ddr_batch_args args;
+    unsigned int i;
+    int ret;
+
+    if (dev->caps & DDR_CAP_BATCH) {
+        args.ops = (uintptr_t)ops;
+        args.count = count;
+        args.failed = -1;
+        ret = ddr_ioctl(dev, DDR_BATCH, &args);
+        *failed = args.failed;
+        return ret;
+    }
+
+    *failed = -1;
+    for (i = 0; i < count; i++) {
+        ops[i].result = batch_op_emulated(dev, &ops[i]);
+        if (ops[i].result) {
+            *failed = i;
+            break;
+        }
+    }
+    return DDR_OK;
+}
+
+int ddr_memtest(ddr_dev *dev, struct ddr_memtest_args *args)
+{
+    return ddr_ioctl(dev, DDR_MEMTEST, args);
+}
+
+int ddr_poll(ddr_dev *dev, unsigned long addr, uint32_t mask, uint32_t expected,
+             uint32_t timeout_us, uint32_t interval_us, uint32_t *value, uint64_t *elapsed_ns)
+{
+    struct ddr_poll_args args;
+    long long start, now;
+    uint32_t v = 0;
+    int ret;
+
+    if (addr % 4)
+        return DDR_ERR_ALIGN;
+    if (!mask || (expected & ~mask))
+        return DDR_ERR_INVALID;
+
+    if (dev->caps & DDR_CAP_POLL) {
+        memset(&args, 0, sizeof(args));
+        args.addr = addr;
+        args.mask = mask;
+        args.expected = expected;
+        args.timeout_us = timeout_us;
+        args.interval_us = interval_us;
+        ret = ddr_ioctl(dev, DDR_POLL, &args);
+        if (ret == DDR_OK || ret == DDR_ERR_TIMEOUT) {
+            if (value)
+                *value = args.value;
+            if (elapsed_ns)
+                *elapsed_ns = args.elapsed_ns;
+        }
+        return ret;
+    }
+
+    start = now_us();
+    for (;;) {
+        now = now_us();
+        ret = ddr_read(dev, addr, &v);
+        if (ret)
+            return ret;
+        if ((v & mask) == expected)
+            break;
+        if (now - start > timeout_us) {
+            ret = DDR_ERR_TIMEOUT;
+            break;
+        }
+        if (interval_us)
+            usleep(interval_us);
+    }
+
+    if (value)
+        *value = v;
+    if (elapsed_ns)
+        *elapsed_ns = (now_us() - start) * 1000ULL;
+    return ret;
+}
+
+int ddr_watch(ddr_dev *dev, const struct ddr_watch_entry *entries, unsigned int count,
+              uint32_t period_us, int eventfd)
+{
+    struct ddr_watch_args args;
+
+    if (!(dev->caps & DDR_CAP_WATCH))
+        return DDR_ERR_INVALID;
+
+    memset(&args, 0, sizeof(args));
+    args.entries = (uintptr_t)entries;
+    args.count = count;
+    args.period_us = period_us;
+    args.eventfd = eventfd;
+    return ddr_ioctl(dev, DDR_WATCH, &args);
+}
+
+int ddr_watch_read(ddr_dev *dev, struct ddr_watch_event *events, unsigned int max,
+                   int timeout_ms)
+{
+    struct pollfd pfd = { .fd = dev->fd, .events = POLLIN };
+    ssize_t n;
+    int ret;
+
+    if (!max)
+        return DDR_ERR_INVALID;
+
+    ret = poll(&pfd, 1, timeout_ms);
+    if (ret < 0) {
+        dev->last_errno = errno;
+        return ddr_status_from_errno(errno);
+    }
+    if (ret == 0)
+        return 0;
+
+    n = read(dev->fd, events, max * sizeof(*events));
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EINTR)
+            return 0;
+        dev->last_errno = errno;
+        return ddr_status_from_errno(errno);
+    }
+    return n / sizeof(*events);
+}
+
+int ddr_queue_read(ddr_dev *dev, unsigned long addr, uint32_t *out)
+{
+    struct ddr_queued *q;
+    size_t cap;
+
+    if (addr % 4 != 0)
+        return DDR_ERR_ALIGN;
+
+    if (dev->queued == dev->queue_cap) {
+        cap = dev->queue_cap ? dev->queue_cap * 2 : 64;
+        q = realloc(dev->queue, cap * sizeof(*q));
+        if (!q)
+            return DDR_ERR_NOMEM;
+        dev->queue = q;
+        dev->queue_cap = cap;
+    }
+
+    dev->queue[dev->queued].addr = addr;
+    dev->queue[dev->queued].out = out;
+    dev->queued++;
+    return DDR_OK;
+}
+
+static int cmp_queued(const void *a, const void *b)
+{
+    const struct ddr_queued *qa = a, *qb = b;
+
+    return qa->addr < qb->addr ? -1 : qa->addr > qb->addr;
+}
+
+int ddr_flush(ddr_dev *dev)
+{
+    struct ddr_queued *q = dev->queue;
+    uint32_t *buf = NULL, *tmp;
+    size_t i, j, k, words, buf_words = 0;
+    int ret = DDR_OK;
+
+    qsort(q, dev->queued, sizeof(*q), cmp_queued);
+
+    for (i = 0; i < dev->queued; i = j) {
+        // extend the run while addresses are equal or adjacent
+        for (j = i + 1; j < dev->queued && q[j].addr - q[j - 1].addr <= 4; j++)
+            ;
+
+        words = (q[j - 1].addr - q[i].addr) / 4 + 1;
+        if (words > buf_words) {
+            tmp = realloc(buf, words * sizeof(*buf));
+            if (!tmp) {
+                ret = DDR_ERR_NOMEM;
+                break;
+            }
+            buf = tmp;
+            buf_words = words;
+        }
+
+        ret = ddr_read_range(dev, q[i].addr, buf, words);
+        if (ret)
+            break;
+        for (k = i; k < j; k++)
+            *q[k].out = buf[(q[k].addr - q[i].addr) / 4];
+    }
+
+    free(buf);
+    dev->queued = 0;
+    return ret;
+}
+
+const char *ddr_strerror(int status)
+{
+    switch (status) {
+    case DDR_OK:          return "Success";
+    case DDR_ERR_OPEN:    return "Cannot open device";
+    case DDR_ERR_ALIGN:   return "Address is not 32-bit aligned";
+    case DDR_ERR_INVALID: return "Invalid argument";
+    case DDR_ERR_EXISTS:  return "Values cannot be overwritten";
+    case DDR_ERR_NOMEM:   return "Out of memory or mapping failed";
+    case DDR_ERR_FAULT:   return "Bad address";
+    case DDR_ERR_TIMEOUT: return "Timed out";
+    case DDR_ERR_PERM:    return "Operation not permitted";
+    default:              return "I/O error";
+    }
+}
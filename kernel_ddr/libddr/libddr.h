@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * libddr - user space access library for /dev/ddr.
+ *
+ * Every call picks the fastest path the loaded module offers: reads inside
+ * the module's mmap window are plain loads, ranges go through
+ * DDR_READ_SG/DDR_WRITE_SG (falling back to 256-word DDR_*_RANGE chunks on
+ * modules without them), single words use the fixed-width DDR_IO, and
+ * batches use DDR_BATCH when available. Writes always go through the
+ * kernel so the write-once check stays in force.
+ */
+#ifndef LIBDDR_H
+#define LIBDDR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../ddr_ioctl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Status codes; every call returns DDR_OK or one of the negative values
+enum ddr_status {
+    DDR_OK            = 0,
+    DDR_ERR_OPEN      = -1,    // could not open the device
+    DDR_ERR_ALIGN     = -2,    // address not aligned to the access width
+    DDR_ERR_INVALID   = -3,    // bad argument or unsupported request
+    DDR_ERR_EXISTS    = -4,    // target already non-zero (write-once)
+    DDR_ERR_NOMEM     = -5,    // mapping or allocation failed
+    DDR_ERR_FAULT     = -6,    // bad user buffer
+    DDR_ERR_TIMEOUT   = -7,    // poll condition not met in time
+    DDR_ERR_PERM      = -8,    // not permitted
+    DDR_ERR_IO        = -9,    // any other errno
+};
+
+// Capabilities detected at ddr_open()
+#define DDR_CAP_MMAP   (1u << 0)
+#define DDR_CAP_SG     (1u << 1)
+#define DDR_CAP_BATCH  (1u << 2)
+#define DDR_CAP_POLL   (1u << 3)
+#define DDR_CAP_WATCH  (1u << 4)
+#define DDR_CAP_IO     (1u << 5)
+#define DDR_CAP_WIDTH  (1u << 6)
+
+typedef struct ddr_dev ddr_dev;
+
+int ddr_open(const char *path, ddr_dev **out);
+void ddr_close(ddr_dev *dev);
+unsigned int ddr_caps(const ddr_dev *dev);
+int ddr_fd(const ddr_dev *dev);
+
+int ddr_read(ddr_dev *dev, unsigned long addr, uint32_t *value);
+int ddr_write(ddr_dev *dev, unsigned long addr, uint32_t value);
+int ddr_read_range(ddr_dev *dev, unsigned long addr, uint32_t *values, size_t count);
+/*
+ * Writes follow the module's per-word write-once rule on every path: each
+ * zero word takes its new value, non-zero words are left as they are, and
+ * the call still returns DDR_OK. (The older qt_regtool module instead
+ * fails a whole DDR_RANGE_MAX-word chunk with DDR_ERR_EXISTS; chunks
+ * before it stay written.)
+ */
+int ddr_write_range(ddr_dev *dev, unsigned long addr, const uint32_t *values, size_t count);
+
+/*
+ * Access in width-byte elements: width is 1, 2, 4 or 8 and addr a
+ * multiple of it. Each element is one bus access, so an 8-byte read of
+ * a 64-bit counter is never torn. Range buffers hold count packed
+ * elements. Widths other than 4 need DDR_CAP_WIDTH (DDR_ERR_INVALID
+ * otherwise, and for 8 on kernels without 64-bit MMIO).
+ */
+int ddr_read_width(ddr_dev *dev, unsigned long addr, unsigned int width, uint64_t *value);
+int ddr_write_width(ddr_dev *dev, unsigned long addr, unsigned int width, uint64_t value);
+int ddr_read_range_width(ddr_dev *dev, unsigned long addr, unsigned int width, void *buf,
+                         size_t count);
+int ddr_write_range_width(ddr_dev *dev, unsigned long addr, unsigned int width,
+                          const void *buf, size_t count);
+
+/*
+ * Run ops in order, stopping at the first failure. *failed receives its
+ * index or -1; per-op results are in ops[i].result.
+ */
+int ddr_batch(ddr_dev *dev, struct ddr_batch_op *ops, unsigned int count, int *failed);
+
+/*
+ * Destructive in-kernel memory test (see struct ddr_memtest_args); needs
+ * CAP_SYS_ADMIN. Returns DDR_OK when the test ran, whatever it found.
+ */
+int ddr_memtest(ddr_dev *dev, struct ddr_memtest_args *args);
+
+/*
+ * Wait until (value & mask) == expected, reading at most interval_us
+ * apart, for up to timeout_us. value and elapsed_ns (either may be NULL)
+ * receive the last value read and the time spent, also on
+ * DDR_ERR_TIMEOUT. A zero mask or expected bits outside mask give
+ * DDR_ERR_INVALID, as in the module. Without DDR_POLL in the module this
+ * loops over ddr_read() in user space.
+ */
+int ddr_poll(ddr_dev *dev, unsigned long addr, uint32_t mask, uint32_t expected,
+             uint32_t timeout_us, uint32_t interval_us, uint32_t *value, uint64_t *elapsed_ns);
+
+/*
+ * Arm a watchlist of up to 64 entries sampled every period_us (>= 100);
+ * count 0 disarms it. eventfd, if >= 0, is signalled on every change in
+ * addition to ddr_fd() becoming readable. ddr_watch_read() waits up to
+ * timeout_ms (-1 forever, 0 not at all) and returns the number of events
+ * stored, 0 on timeout or once no watchlist is armed (it then returns at
+ * once instead of waiting), or a DDR_ERR_* code.
+ */
+int ddr_watch(ddr_dev *dev, const struct ddr_watch_entry *entries, unsigned int count,
+              uint32_t period_us, int eventfd);
+int ddr_watch_read(ddr_dev *dev, struct ddr_watch_event *events, unsigned int max,
+                   int timeout_ms);
+
+/*
+ * Deferred reads: queue any number of single-word reads, then ddr_flush()
+ * performs them with adjacent addresses coalesced into range reads and
+ * stores each result through its out pointer.
+ */
+int ddr_queue_read(ddr_dev *dev, unsigned long addr, uint32_t *out);
+int ddr_flush(ddr_dev *dev);
+
+// errno from the last failed system call, for messages
+int ddr_last_errno(const ddr_dev *dev);
+int ddr_status_from_errno(int err);
+const char *ddr_strerror(int status);
+
+/*
+ * Asynchronous submission over io_uring (IORING_OP_URING_CMD). Commands
+ * are queued with ddr_async_*(), sent with ddr_async_submit() and their
+ * completions collected with ddr_async_reap(); the calling thread never
+ * waits on the hardware. The argument struct passed to each call is read
+ * by the kernel when the command runs, so it must stay valid and
+ * untouched until its completion has been reaped.
+ */
+typedef struct ddr_async ddr_async;
+
+struct ddr_async_cqe {
+    uint64_t user_data;
+    int status;     // DDR_OK or a DDR_ERR_* code
+    int err;        // errno behind status, 0 on success
+};
+
+int ddr_async_open(ddr_dev *dev, unsigned int depth, ddr_async **out);
+void ddr_async_close(ddr_async *as);
+
+// eventfd signalled on every completion, for poll/epoll based loops
+int ddr_async_eventfd(ddr_async *as);
+
+// Queue any DDR_* command with its argument struct
+int ddr_async_cmd(ddr_async *as, unsigned int cmd, void *arg, uint64_t user_data);
+int ddr_async_read(ddr_async *as, struct ddr_rw_args *args, uint64_t user_data);
+int ddr_async_write(ddr_async *as, struct ddr_rw_args *args, uint64_t user_data);
+int ddr_async_xfer(ddr_async *as, struct ddr_xfer_args *args, int write, uint64_t user_data);
+int ddr_async_batch(ddr_async *as, struct ddr_batch_args *args, uint64_t user_data);
+
+// Returns the number of commands handed to the kernel or a DDR_ERR_* code
+int ddr_async_submit(ddr_async *as);
+
+/*
+ * Store up to max completions in cqes, waiting until at least min_wait
+ * are available. Returns the number stored or a DDR_ERR_* code.
+ */
+int ddr_async_reap(ddr_async *as, struct ddr_async_cqe *cqes, unsigned int max,
+                   unsigned int min_wait);
+
+/*
+ * High-rate sampler on /dev/ddr_sample: nregs registers read every
+ * period_ns into a ring of slots samples shared with the kernel. cpu >= 0
+ * pins a busy-waiting sampler thread to that CPU, -1 uses a timer.
+ * ddr_sample_read() copies out up to max samples of
+ * ddr_sample_slot_size() bytes each (struct ddr_sample + values) and
+ * returns how many, 0 when none are pending.
+ */
+typedef struct ddr_sampler ddr_sampler;
+
+int ddr_sample_open(const char *path, const uint64_t *addrs, unsigned int nregs,
+                    uint32_t period_ns, uint32_t slots, int cpu, ddr_sampler **out);
+void ddr_sample_close(ddr_sampler *s);
+size_t ddr_sample_slot_size(const ddr_sampler *s);
+int ddr_sample_read(ddr_sampler *s, void *buf, unsigned int max);
+void ddr_sample_stats(const ddr_sampler *s, uint64_t *overruns, uint64_t *missed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBDDR_H
@@ -1,43 +1,33 @@
 #include <stdio.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
 #include <stdint.h>
 
-#define DEVICE "/dev/ddr"
-
-#define DDR_IOC_MAGIC  'k'
-#define DDR_READ       _IOWR(DDR_IOC_MAGIC, 1, struct ddr_rw_args)
-#define DDR_WRITE      _IOW(DDR_IOC_MAGIC,  2, struct ddr_rw_args)
-
-struct ddr_rw_args {
-    unsigned long addr;
-    uint32_t value;
-};
+#include "../libddr/libddr.h"
 
 int main() {
-    int fd = open(DEVICE, O_RDWR);
-    if (fd < 0) {
+    ddr_dev *dev;
+    if (ddr_open(NULL, &dev)) {
         perror("open");
         return 1;
     }
 
-    struct ddr_rw_args req;
-    req.addr = 0x100;
-    req.value = 0x55;
+    unsigned long addr = 0x100;
+    uint32_t value = 0x55;
+    int ret;
 
-    if (ioctl(fd, DDR_WRITE, &req) < 0) {
-        perror("ioctl write");
+    ret = ddr_write(dev, addr, value);
+    if (ret) {
+        fprintf(stderr, "write: %s\n", ddr_strerror(ret));
     } else {
-        printf("Wrote 0x%x to [0x%lx]\n", req.value, req.addr);
+        printf("Wrote 0x%x to [0x%lx]\n", value, addr);
     }
 
-    if (ioctl(fd, DDR_READ, &req) < 0) {
-        perror("ioctl read");
+    ret = ddr_read(dev, addr, &value);
+    if (ret) {
+        fprintf(stderr, "read: %s\n", ddr_strerror(ret));
     } else {
-        printf("Read [0x%lx] = 0x%x\n", req.addr, req.value);
+        printf("Read [0x%lx] = 0x%x\n", addr, value);
     }
 
-    close(fd);
+    ddr_close(dev);
     return 0;
 }
@@ -9,6 +9,9 @@
 #include <linux/device.h>
 #include <linux/ioctl.h>
 #include <linux/version.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
+#include <linux/slab.h>
 
 #define DEVICE_NAME "ddr"
 #define CLASS_NAME  "ddr_class"
@@ -29,6 +32,9 @@ static int ddr_major;
 static struct class *ddr_class;
 static struct device *ddr_device;
 
+/* Serialises the write-once check against the write itself */
+static DEFINE_MUTEX(ddr_write_lock);
+
 struct ddr_rw_args {
     unsigned long addr;
     u32 value;
@@ -44,7 +50,9 @@ static long ddr_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
     struct ddr_rw_args rw_args;
     struct ddr_range_args range_args;
+    u32 *snapshot;
     void __iomem *vaddr;
+    size_t len;
     int i;
 
     switch (cmd) {
@@ -78,12 +86,15 @@ static long ddr_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
             return -ENOMEM;
 
         /* DO NOT OVERWRITE if non-zero: return -EEXIST */
+        mutex_lock(&ddr_write_lock);
         if (ioread32(vaddr) != 0) {
+            mutex_unlock(&ddr_write_lock);
             iounmap(vaddr);
             return -EEXIST;
         }
 
         iowrite32(rw_args.value, vaddr);
+        mutex_unlock(&ddr_write_lock);
         iounmap(vaddr);
         break;
 
@@ -121,30 +132,35 @@ static long ddr_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
         if (range_args.count <= 0 || range_args.count > 256)
             return -EINVAL;
 
-        /* First pass: if ANY target is non-zero, abort and return -EEXIST */
-        for (i = 0; i < range_args.count; i++) {
-            unsigned long addr = range_args.addr + i * 4;
-            vaddr = ioremap(addr, 4);
-            if (!vaddr)
-                return -ENOMEM;
+        len = range_args.count * sizeof(u32);
+        snapshot = kmalloc(len, GFP_KERNEL);
+        if (!snapshot)
+            return -ENOMEM;
 
-            if (ioread32(vaddr) != 0) {
-                iounmap(vaddr);
-                return -EEXIST;
-            }
-            iounmap(vaddr);
+        vaddr = ioremap(range_args.addr, len);
+        if (!vaddr) {
+            kfree(snapshot);
+            return -ENOMEM;
         }
 
-        /* Second pass: all clear, perform writes */
-        for (i = 0; i < range_args.count; i++) {
-            unsigned long addr = range_args.addr + i * 4;
-            vaddr = ioremap(addr, 4);
-            if (!vaddr)
-                return -ENOMEM;
-
-            iowrite32(range_args.values[i], vaddr);
+        /*
+         * Snapshot the whole range once: if ANY target is non-zero, abort
+         * with -EEXIST, otherwise write it in one go. The lock keeps other
+         * writers out between the check and the write.
+         */
+        mutex_lock(&ddr_write_lock);
+        memcpy_fromio(snapshot, vaddr, len);
+        if (memchr_inv(snapshot, 0, len)) {
+            mutex_unlock(&ddr_write_lock);
             iounmap(vaddr);
+            kfree(snapshot);
+            return -EEXIST;
         }
+
+        memcpy_toio(vaddr, range_args.values, len);
+        mutex_unlock(&ddr_write_lock);
+        iounmap(vaddr);
+        kfree(snapshot);
         break;
 
     default:
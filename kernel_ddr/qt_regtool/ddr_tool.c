@@ -1,30 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
 #include <string.h>
-#include <errno.h>
 #include <stdint.h>
 
-#define DEVICE "/dev/ddr"
-
-#define DDR_IOC_MAGIC  'k'
-#define DDR_READ        _IOWR(DDR_IOC_MAGIC, 1, struct ddr_rw_args)
-#define DDR_WRITE       _IOW(DDR_IOC_MAGIC,  2, struct ddr_rw_args)
-#define DDR_READ_RANGE  _IOWR(DDR_IOC_MAGIC, 3, struct ddr_range_args)
-#define DDR_WRITE_RANGE _IOW(DDR_IOC_MAGIC,  4, struct ddr_range_args)
-
-struct ddr_rw_args {
-    unsigned long addr;
-    uint32_t value;
-};
-
-struct ddr_range_args {
-    unsigned long addr;
-    uint32_t values[256];
-    int count;
-};
+#include "../libddr/libddr.h"
 
 int main(int argc, char *argv[])
 {
@@ -37,69 +16,94 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    int fd = open(DEVICE, O_RDWR);
-    if (fd < 0) {
+    ddr_dev *dev;
+    if (ddr_open(NULL, &dev)) {
         perror("open");
         return 1;
     }
 
+    int ret = 0;
     if (!strcmp(argv[1], "read")) {
-        struct ddr_rw_args req = { strtoul(argv[2], NULL, 16), 0 };
-        if (ioctl(fd, DDR_READ, &req) < 0) {
-            perror("ioctl read");
+        unsigned long addr = strtoul(argv[2], NULL, 16);
+        uint32_t value;
+        ret = ddr_read(dev, addr, &value);
+        if (ret) {
+            fprintf(stderr, "read: %s\n", ddr_strerror(ret));
+            ddr_close(dev);
             return 1;
         }
-        printf("Read [0x%lx] = 0x%x\n", req.addr, req.value);
+        printf("Read [0x%lx] = 0x%x\n", addr, value);
 
     } else if (!strcmp(argv[1], "write")) {
         if (argc < 4) {
             fprintf(stderr, "Missing value\n");
+            ddr_close(dev);
             return 1;
         }
-        struct ddr_rw_args req = { strtoul(argv[2], NULL, 16), strtoul(argv[3], NULL, 16) };
-        if (ioctl(fd, DDR_WRITE, &req) < 0) {
-            perror("ioctl write");
+        unsigned long addr = strtoul(argv[2], NULL, 16);
+        uint32_t value = strtoul(argv[3], NULL, 16);
+        ret = ddr_write(dev, addr, value);
+        if (ret) {
+            fprintf(stderr, "write: %s\n", ddr_strerror(ret));
+            ddr_close(dev);
             return 1;
         }
-        printf("Wrote [0x%lx] = 0x%x\n", req.addr, req.value);
+        printf("Wrote [0x%lx] = 0x%x\n", addr, value);
 
     } else if (!strcmp(argv[1], "readrange")) {
         if (argc < 4) {
             fprintf(stderr, "Need address and count\n");
+            ddr_close(dev);
             return 1;
         }
-        struct ddr_range_args req;
-        req.addr = strtoul(argv[2], NULL, 16);
-        req.count = atoi(argv[3]);
-
-        if (ioctl(fd, DDR_READ_RANGE, &req) < 0) {
-            perror("ioctl readrange");
+        unsigned long addr = strtoul(argv[2], NULL, 16);
+        int count = atoi(argv[3]);
+        if (count <= 0) {
+            fprintf(stderr, "Count must be positive\n");
+            ddr_close(dev);
             return 1;
         }
-        for (int i = 0; i < req.count; i++)
-            printf("Read [0x%lx] = 0x%x\n", req.addr + i*4, req.values[i]);
+        uint32_t *values = malloc(count * sizeof(*values));
+        if (!values || (ret = ddr_read_range(dev, addr, values, count))) {
+            fprintf(stderr, "readrange: %s\n", ddr_strerror(values ? ret : DDR_ERR_NOMEM));
+            free(values);
+            ddr_close(dev);
+            return 1;
+        }
+        for (int i = 0; i < count; i++)
+            printf("Read [0x%lx] = 0x%x\n", addr + i*4, values[i]);
+        free(values);
 
     } else if (!strcmp(argv[1], "writerange")) {
         if (argc < 4) {
             fprintf(stderr, "Need address and values\n");
+            ddr_close(dev);
+            return 1;
+        }
+        unsigned long addr = strtoul(argv[2], NULL, 16);
+        int count = argc - 3;
+        uint32_t *values = malloc(count * sizeof(*values));
+        if (!values) {
+            perror("malloc");
+            ddr_close(dev);
             return 1;
         }
-        struct ddr_range_args req;
-        req.addr = strtoul(argv[2], NULL, 16);
-        req.count = argc - 3;
-        for (int i = 0; i < req.count; i++)
-            req.values[i] = strtoul(argv[3+i], NULL, 16);
+        for (int i = 0; i < count; i++)
+            values[i] = strtoul(argv[3+i], NULL, 16);
 
-        if (ioctl(fd, DDR_WRITE_RANGE, &req) < 0) {
-            perror("ioctl writerange");
+        ret = ddr_write_range(dev, addr, values, count);
+        free(values);
+        if (ret) {
+            fprintf(stderr, "writerange: %s\n", ddr_strerror(ret));
+            ddr_close(dev);
             return 1;
         }
-        printf("Wrote %d values starting at 0x%lx\n", req.count, req.addr);
+        printf("Wrote %d values starting at 0x%lx\n", count, addr);
 
     } else {
         fprintf(stderr, "Unknown command: %s\n", argv[1]);
     }
 
-    close(fd);
+    ddr_close(dev);
     return 0;
 }
@@ -3,42 +3,26 @@
 #include <QFile>
 #include <QFileDialog>
 #include <QApplication>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
-#include <cerrno>
-#include <cstring>
 #include <cstdint>
-
-// Must match ddr.c
-#define DDR_IOC_MAGIC  'k'
-#define DDR_READ        _IOWR(DDR_IOC_MAGIC, 1, struct ddr_rw_args)
-#define DDR_WRITE       _IOW(DDR_IOC_MAGIC,  2, struct ddr_rw_args)
-#define DDR_READ_RANGE  _IOWR(DDR_IOC_MAGIC, 3, struct ddr_range_args)
-#define DDR_WRITE_RANGE _IOW(DDR_IOC_MAGIC,  4, struct ddr_range_args)
-
-struct ddr_rw_args {
-    unsigned long addr;
-    uint32_t value;
-};
-
-struct ddr_range_args {
-    unsigned long addr;
-    uint32_t values[256];
-    int count;
-};
+#include <vector>
 
 MainWindow::MainWindow(QWidget *parent)
-    : QWidget(parent), fd(-1)
+    : QWidget(parent)
 {
     QLabel *addrLabel = new QLabel("Address (hex):");
     QLabel *valueLabel = new QLabel("Value (hex):");
     QLabel *countLabel = new QLabel("Count:");
     QLabel *rangeLabel = new QLabel("Range Values (hex, space-separated):");
+    QLabel *maskLabel = new QLabel("Poll Mask (hex):");
+    QLabel *timeoutLabel = new QLabel("Timeout (us):");
+    QLabel *intervalLabel = new QLabel("Interval (us):");
 
     addrEdit = new QLineEdit(this);
     valueEdit = new QLineEdit(this);
     countEdit = new QLineEdit(this);
+    maskEdit = new QLineEdit("FFFFFFFF", this);
+    timeoutEdit = new QLineEdit("1000000", this);
+    intervalEdit = new QLineEdit("100", this);
 
     rangeEdit = new QTextEdit(this);
     rangeEdit->setMinimumHeight(200);  // 👉 bigger
@@ -48,6 +32,10 @@ MainWindow::MainWindow(QWidget *parent)
     writeButton = new QPushButton("Write", this);
     readRangeButton = new QPushButton("Read Range", this);
     writeRangeButton = new QPushButton("Write Range", this);
+    pollButton = new QPushButton("Poll", this);
+    watchButton = new QPushButton("Watch", this);
+    watchButton->setCheckable(true);
+    watchNotifier = nullptr;
 
     // 👉 keyboard shortcuts
     readButton->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_R));
@@ -88,9 +76,19 @@ MainWindow::MainWindow(QWidget *parent)
     cntLayout->addWidget(countLabel);
     cntLayout->addWidget(countEdit);
 
+    // poll waits until (value at address & mask) == Value
+    QHBoxLayout *pollLayout = new QHBoxLayout;
+    pollLayout->addWidget(maskLabel);
+    pollLayout->addWidget(maskEdit);
+    pollLayout->addWidget(timeoutLabel);
+    pollLayout->addWidget(timeoutEdit);
+    pollLayout->addWidget(intervalLabel);
+    pollLayout->addWidget(intervalEdit);
+
     mainLayout->addLayout(addrLayout);
     mainLayout->addLayout(valLayout);
     mainLayout->addLayout(cntLayout);
+    mainLayout->addLayout(pollLayout);
     mainLayout->addWidget(rangeLabel);
     mainLayout->addWidget(rangeEdit);
 
@@ -99,6 +97,8 @@ MainWindow::MainWindow(QWidget *parent)
     btnLayout->addWidget(writeButton);
     btnLayout->addWidget(readRangeButton);
     btnLayout->addWidget(writeRangeButton);
+    btnLayout->addWidget(pollButton);
+    btnLayout->addWidget(watchButton);
 
     mainLayout->addLayout(btnLayout);
 
@@ -110,17 +110,19 @@ MainWindow::MainWindow(QWidget *parent)
     connect(writeButton, &QPushButton::clicked, this, &MainWindow::onWriteClicked);
     connect(readRangeButton, &QPushButton::clicked, this, &MainWindow::onReadRangeClicked);
     connect(writeRangeButton, &QPushButton::clicked, this, &MainWindow::onWriteRangeClicked);
+    connect(pollButton, &QPushButton::clicked, this, &MainWindow::onPollClicked);
+    connect(watchButton, &QPushButton::clicked, this, &MainWindow::onWatchClicked);
 
     // --- Enter key smart behavior ---
     connect(addrEdit, &QLineEdit::returnPressed, this, &MainWindow::onReadClicked);
     connect(valueEdit, &QLineEdit::returnPressed, this, &MainWindow::onWriteClicked);
     connect(countEdit, &QLineEdit::returnPressed, this, &MainWindow::onReadRangeClicked);
 
-    // open device
-    fd = open("/dev/ddr", O_RDWR);
-    if (fd < 0) {
+    // device is opened by the DdrDevice member
+    if (!ddr.isOpen()) {
         QMessageBox::critical(this, "Error",
-            QString("Failed to open /dev/ddr: %1").arg(strerror(errno)));
+            QString("Failed to open %1: %2").arg(DDR_DEVICE_PATH)
+                .arg(DdrDevice::errorString(ddr.openError())));
     }
 
     // 👉 set initial size
@@ -128,33 +130,33 @@ MainWindow::MainWindow(QWidget *parent)
 }
 
 void MainWindow::onReadClicked() {
-    if (fd < 0) return;
+    if (!ddr.isOpen()) return;
     bool ok;
     unsigned long addr = addrEdit->text().toULong(&ok, 16);
     if (!ok) { QMessageBox::warning(this,"Input Error","Invalid address!"); return; }
-    ddr_rw_args req{addr,0};
-    if (ioctl(fd, DDR_READ, &req) == -1) {
-        QMessageBox::warning(this,"Read Failed",strerror(errno)); return;
+    uint32_t value = 0;
+    DdrError err = ddr.read(addr, value);
+    if (err != DdrError::Ok) {
+        QMessageBox::warning(this,"Read Failed",DdrDevice::errorString(err)); return;
     }
-    valueEdit->setText(QString::number(req.value,16).toUpper());
+    valueEdit->setText(QString::number(value,16).toUpper());
 }
 
 void MainWindow::onWriteClicked() {
-    if (fd < 0) return;
+    if (!ddr.isOpen()) return;
     bool ok1, ok2;
     unsigned long addr = addrEdit->text().toULong(&ok1, 16);
     unsigned int val = valueEdit->text().toUInt(&ok2, 16);
     if (!ok1 || !ok2) { QMessageBox::warning(this,"Input Error","Invalid addr/value!"); return; }
 
-    ddr_rw_args req{addr,val};
-    int ret = ioctl(fd, DDR_WRITE, &req);
-    if (ret == -1) {
-        if (errno == EEXIST) {
+    DdrError err = ddr.write(addr, val);
+    if (err != DdrError::Ok) {
+        if (err == DdrError::Exists) {
             // <<-- only change requested: unified message
             QMessageBox::warning(this, "Write Failed",
                 QString("Values cannot be overwritten"));
         } else {
-            QMessageBox::warning(this,"Write Failed",strerror(errno));
+            QMessageBox::warning(this,"Write Failed",DdrDevice::errorString(err));
         }
         return;
     }
@@ -163,44 +165,42 @@ void MainWindow::onWriteClicked() {
 }
 
 void MainWindow::onReadRangeClicked() {
-    if (fd < 0) return;
+    if (!ddr.isOpen()) return;
     bool ok1, ok2;
     unsigned long addr = addrEdit->text().toULong(&ok1, 16);
     int count = countEdit->text().toInt(&ok2);
-    if (!ok1 || !ok2 || count<=0 || count>256) {
+    if (!ok1 || !ok2 || count<=0) {
         QMessageBox::warning(this,"Input Error","Invalid addr/count!"); return;
     }
-    ddr_range_args req;
-    req.addr=addr; req.count=count;
-    if (ioctl(fd, DDR_READ_RANGE, &req) == -1) {
-        QMessageBox::warning(this,"ReadRange Failed",strerror(errno)); return;
+    std::vector<uint32_t> values;
+    DdrError err = ddr.readRange(addr, values, count);
+    if (err != DdrError::Ok) {
+        QMessageBox::warning(this,"ReadRange Failed",DdrDevice::errorString(err)); return;
     }
     QString result;
     for(int i=0;i<count;i++)
-        result += QString("0x%1 ").arg(req.values[i],0,16).toUpper();
+        result += QString("0x%1 ").arg(values[i],0,16).toUpper();
     rangeEdit->setText(result.trimmed());
 }
 
 void MainWindow::onWriteRangeClicked() {
-    if (fd < 0) return;
+    if (!ddr.isOpen()) return;
     bool ok;
     unsigned long addr = addrEdit->text().toULong(&ok, 16);
     if (!ok) { QMessageBox::warning(this,"Input Error","Invalid address!"); return; }
     QStringList tokens = rangeEdit->toPlainText().split(QRegExp("\\s+"), Qt::SkipEmptyParts);
     if (tokens.isEmpty()) { QMessageBox::warning(this,"Input Error","No values!"); return; }
-    ddr_range_args req;
-    req.addr=addr; req.count=tokens.size();
-    if (req.count>256) { QMessageBox::warning(this,"Input Error","Too many values!"); return; }
-    for(int i=0;i<req.count;i++) req.values[i]=tokens[i].toUInt(&ok,16);
-
-    int ret = ioctl(fd, DDR_WRITE_RANGE, &req);
-    if (ret == -1) {
-        if (errno == EEXIST) {
+    std::vector<uint32_t> values(tokens.size());
+    for(int i=0;i<tokens.size();i++) values[i]=tokens[i].toUInt(&ok,16);
+
+    DdrError err = ddr.writeRange(addr, values);
+    if (err != DdrError::Ok) {
+        if (err == DdrError::Exists) {
             // <<-- only change requested: unified message
             QMessageBox::warning(this,"WriteRange Failed",
                 QString("Values cannot be overwritten"));
         } else {
-            QMessageBox::warning(this,"WriteRange Failed",strerror(errno));
+            QMessageBox::warning(this,"WriteRange Failed",DdrDevice::errorString(err));
         }
         return;
     }
@@ -208,6 +208,80 @@ void MainWindow::onWriteRangeClicked() {
     QMessageBox::information(this,"Success","Range written successfully!");
 }
 
+void MainWindow::onPollClicked() {
+    if (!ddr.isOpen()) return;
+    bool ok1, ok2, ok3, ok4, ok5;
+    unsigned long addr = addrEdit->text().toULong(&ok1, 16);
+    uint32_t expected = valueEdit->text().toUInt(&ok2, 16);
+    uint32_t mask = maskEdit->text().toUInt(&ok3, 16);
+    uint32_t timeoutUs = timeoutEdit->text().toUInt(&ok4);
+    uint32_t intervalUs = intervalEdit->text().toUInt(&ok5);
+    if (!ok1 || !ok2 || !ok3 || !ok4 || !ok5) {
+        QMessageBox::warning(this,"Input Error","Invalid addr/value/mask/timeout/interval!"); return;
+    }
+
+    uint32_t value = 0;
+    uint64_t elapsedNs = 0;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    DdrError err = ddr.poll(addr, mask, expected, timeoutUs, intervalUs, value, elapsedNs);
+    QApplication::restoreOverrideCursor();
+    if (err != DdrError::Ok && err != DdrError::Timeout) {
+        QMessageBox::warning(this,"Poll Failed",DdrDevice::errorString(err)); return;
+    }
+
+    QString msg = QString("Value 0x%1 after %2 us")
+                      .arg(value,0,16).arg(elapsedNs / 1000);
+    if (err == DdrError::Timeout)
+        QMessageBox::warning(this,"Poll Timed Out",msg);
+    else
+        QMessageBox::information(this,"Condition Met",msg);
+}
+
+// Watch the address with the poll mask; the module samples it every
+// Interval (us) and the value field follows changes without polling here.
+void MainWindow::onWatchClicked() {
+    if (!ddr.isOpen()) { watchButton->setChecked(false); return; }
+
+    if (!watchButton->isChecked()) {
+        // the disarmed fd polls as hung up; drop the notifier first
+        delete watchNotifier;
+        watchNotifier = nullptr;
+        ddr.watch({}, 0);
+        return;
+    }
+
+    bool ok1, ok2, ok3;
+    ddr_watch_entry entry = {};
+    entry.addr = addrEdit->text().toULong(&ok1, 16);
+    entry.mask = maskEdit->text().toUInt(&ok2, 16);
+    uint32_t periodUs = intervalEdit->text().toUInt(&ok3);
+    if (!ok1 || !ok2 || !ok3) {
+        QMessageBox::warning(this,"Input Error","Invalid addr/mask/interval!");
+        watchButton->setChecked(false);
+        return;
+    }
+
+    DdrError err = ddr.watch({entry}, periodUs);
+    if (err != DdrError::Ok) {
+        QMessageBox::warning(this,"Watch Failed",DdrDevice::errorString(err));
+        watchButton->setChecked(false);
+        return;
+    }
+
+    uint32_t value = 0;
+    if (ddr.read(entry.addr, value) == DdrError::Ok)
+        valueEdit->setText(QString::number(value,16).toUpper());
+
+    watchNotifier = new QSocketNotifier(ddr.fd(), QSocketNotifier::Read, this);
+    connect(watchNotifier, &QSocketNotifier::activated, this, &MainWindow::onWatchEvent);
+}
+
+void MainWindow::onWatchEvent() {
+    std::vector<ddr_watch_event> events;
+    if (ddr.readEvents(events, 64, 0) <= 0 || events.empty()) return;
+    valueEdit->setText(QString::number(events.back().new_value,16).toUpper());
+}
+
 void MainWindow::onOpenTriggered() {
     QString path = QFileDialog::getOpenFileName(
         this,
@@ -11,6 +11,9 @@
 #include <QMenuBar>
 #include <QMenu>
 #include <QAction>
+#include <QSocketNotifier>
+
+#include "DdrDevice.h"
 
 class MainWindow : public QWidget {
     Q_OBJECT
@@ -23,17 +26,26 @@ private slots:
     void onWriteClicked();
     void onReadRangeClicked();
     void onWriteRangeClicked();   // ✅ semicolon
+    void onPollClicked();
+    void onWatchClicked();
+    void onWatchEvent();
     void onOpenTriggered();       // ✅ semicolon
 
 private:
     QLineEdit *addrEdit;
     QLineEdit *valueEdit;
     QLineEdit *countEdit;
+    QLineEdit *maskEdit;
+    QLineEdit *timeoutEdit;
+    QLineEdit *intervalEdit;
     QTextEdit *rangeEdit;
     QPushButton *readButton;
     QPushButton *writeButton;
     QPushButton *readRangeButton;
     QPushButton *writeRangeButton;
+    QPushButton *pollButton;
+    QPushButton *watchButton;
+    QSocketNotifier *watchNotifier;
 
     // menubar
     QMenuBar *menuBar;
@@ -41,7 +53,7 @@ private:
     QAction *openAct;
     QAction *exitAct;
 
-    int fd;
+    DdrDevice ddr;
 };
 
 #endif // MAINWINDOW_H
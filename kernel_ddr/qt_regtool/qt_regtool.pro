@@ -11,3 +11,8 @@ SOURCES += \
 
 HEADERS += \
     mainwindow.h
+
+# shared /dev/ddr access library (build ../libddr first)
+INCLUDEPATH += $$PWD/../libddr
+LIBS += -L$$PWD/../libddr -lddr
+PRE_TARGETDEPS += $$PWD/../libddr/libddr.a
@@ -0,0 +1,1553 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * vreg_server - native implementation of the virt_reg_server.py REST API.
+ *
+ * Serves the same /api/v1 endpoints with the same checks, status codes and
+ * JSON bodies. The register image is a MAP_SHARED mapping of the backing
+ * file, updated in place and flushed with msync() according to --sync
+ * instead of rewriting the whole file on every change. Each worker thread
+ * runs its own epoll loop over non-blocking TLS connections on a
+ * SO_REUSEPORT listener; HTTP/1.1 keep-alive and pipelining are supported.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+namespace {
+
+// Python ints are unbounded; parsed values are clamped to +-2^80, far
+// outside any valid address, width, count or 64-bit value.
+using Int = __int128;
+constexpr Int kIntClamp = Int(1) << 80;
+
+constexpr size_t kMaxHeader = 16 * 1024;
+constexpr size_t kMaxBody = 64 * 1024 * 1024;
+constexpr size_t kMaxOut = 1024 * 1024;     // stop reading until replies drain
+
+enum class SyncMode { Always, Interval, None };
+
+struct Config {
+    uint64_t base = 0x80000000;
+    uint64_t size = 0x10000;
+    std::string file = "vreg.bin";
+    std::string cert = "certs/server.crt";
+    std::string key = "certs/server.key";
+    std::string host = "0.0.0.0";
+    int port = 8443;
+    unsigned threads = 0;
+    bool tls = true;
+    SyncMode sync = SyncMode::Interval;
+    unsigned syncMs = 100;
+};
+
+std::atomic<bool> stopping{false};
+
+// abort(code, message) of the Flask server
+struct HttpError {
+    int code;
+    std::string message;
+};
+
+[[noreturn]] void fail(int code, std::string message) {
+    throw HttpError{code, std::move(message)};
+}
+
+// An uncaught Python exception (a TypeError from int()): the Flask
+// server's catch-all handler turns it into a 500 InternalServerError
+struct PyError {
+    std::string message;
+};
+
+/*
+ * Register image backed by a shared file mapping. Readers take lock()
+ * shared and writers exclusive, so a request sees and applies its whole
+ * check-then-write atomically, as under the GIL. Dirty pages are tracked
+ * as one byte range and written back by flushDirty().
+ */
+class RegImage {
+public:
+    ~RegImage() {
+        if (mem_)
+            munmap(mem_, size_);
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    bool open(const std::string &path, size_t size) {
+        struct stat st;
+
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0 || fstat(fd_, &st))
+            return false;
+        // like the Python server, an image of the wrong size starts zeroed
+        if ((uint64_t)st.st_size != size) {
+            if (st.st_size)
+                fprintf(stderr, "%s: size %lld, expected %zu; starting empty\n",
+                        path.c_str(), (long long)st.st_size, size);
+            if (ftruncate(fd_, 0) || ftruncate(fd_, size))
+                return false;
+        }
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED)
+            return false;
+        mem_ = static_cast<uint8_t *>(p);
+        size_ = size;
+        return true;
+    }
+
+    uint8_t *data() { return mem_; }
+    size_t size() const { return size_; }
+    std::shared_mutex &lock() { return lock_; }
+
+    void markDirty(size_t off, size_t len) {
+        std::lock_guard<std::mutex> g(dirtyLock_);
+        dirtyLo_ = std::min(dirtyLo_, off);
+        dirtyHi_ = std::max(dirtyHi_, off + len);
+    }
+
+    // Write back [off, off + len) now
+    void sync(size_t off, size_t len) {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t lo = off / page * page;
+
+        if (msync(mem_ + lo, off + len - lo, MS_SYNC))
+            perror("msync");
+    }
+
+    void flushDirty() {
+        size_t lo, hi;
+        {
+            std::lock_guard<std::mutex> g(dirtyLock_);
+            lo = dirtyLo_;
+            hi = dirtyHi_;
+            dirtyLo_ = SIZE_MAX;
+            dirtyHi_ = 0;
+        }
+        if (lo < hi)
+            sync(lo, hi - lo);
+    }
+
+private:
+    int fd_ = -1;
+    uint8_t *mem_ = nullptr;
+    size_t size_ = 0;
+    std::shared_mutex lock_;
+    std::mutex dirtyLock_;
+    size_t dirtyLo_ = SIZE_MAX;
+    size_t dirtyHi_ = 0;
+};
+
+// ---- number parsing with Python int() rules ----
+
+/*
+ * int(s, 0) when base0, else int(s): surrounding whitespace, a sign,
+ * 0x/0o/0b prefixes (base 0 only, where decimals may not have leading
+ * zeros) and single '_' between digits.
+ */
+std::optional<Int> parsePyInt(std::string_view s, bool base0) {
+    auto space = [](char c) { return c == ' ' || (c >= '\t' && c <= '\r'); };
+    while (!s.empty() && space(s.front()))
+        s.remove_prefix(1);
+    while (!s.empty() && space(s.back()))
+        s.remove_suffix(1);
+
+    bool neg = false;
+    if (!s.empty() && (s[0] == '+' || s[0] == '-')) {
+        neg = s[0] == '-';
+        s.remove_prefix(1);
+    }
+
+    int radix = 10;
+    bool prefixed = false;
+    if (base0 && s.size() > 1 && s[0] == '0') {
+        char p = s[1] | 0x20;
+        radix = p == 'x' ? 16 : p == 'o' ? 8 : p == 'b' ? 2 : 10;
+        if (radix != 10) {
+            s.remove_prefix(2);
+            prefixed = true;
+        }
+    }
+    // "0x_1f" is valid, "0x" and "_1" are not
+    if (prefixed && !s.empty() && s[0] == '_')
+        s.remove_prefix(1);
+    if (s.empty() || s.front() == '_' || s.back() == '_')
+        return std::nullopt;
+
+    Int v = 0;
+    bool nonzero = false;
+    char prev = 0;
+    for (char c : s) {
+        int d;
+        if (c == '_') {
+            if (prev == '_')
+                return std::nullopt;
+            prev = c;
+            continue;
+        }
+        if (c >= '0' && c <= '9')
+            d = c - '0';
+        else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')
+            d = (c | 0x20) - 'a' + 10;
+        else
+            return std::nullopt;
+        if (d >= radix)
+            return std::nullopt;
+        nonzero |= d != 0;
+        v = std::min<Int>(v * radix + d, kIntClamp);
+        prev = c;
+    }
+    if (base0 && !prefixed && s[0] == '0' && nonzero)
+        return std::nullopt;        // "010"
+    return neg ? -v : v;
+}
+
+std::string hex(Int v) {
+    char buf[40];
+    unsigned long long u = (unsigned long long)(v < 0 ? -v : v);
+    snprintf(buf, sizeof(buf), "%s0x%llx", v < 0 ? "-" : "", u);
+    return buf;
+}
+
+// ---- minimal JSON ----
+
+struct Json {
+    enum Type { Null, Bool, Number, String, Array, Object } type = Null;
+    bool b = false;
+    std::string s;      // string value or the number's literal text
+    std::vector<Json> items;
+    std::vector<std::pair<std::string, Json>> fields;
+
+    // Python's json keeps the last of duplicate keys
+    const Json *get(std::string_view key) const {
+        if (type != Object)
+            return nullptr;
+        for (auto it = fields.rbegin(); it != fields.rend(); ++it)
+            if (it->first == key)
+                return &it->second;
+        return nullptr;
+    }
+
+    bool truthy() const {
+        switch (type) {
+        case Null:   return false;
+        case Bool:   return b;
+        case Number: return strtod(s.c_str(), nullptr) != 0;
+        case String: return !s.empty();
+        case Array:  return !items.empty();
+        case Object: return !fields.empty();
+        }
+        return false;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(std::string_view text) : p_(text.data()), end_(text.data() + text.size()) {}
+
+    bool parse(Json &out) {
+        if (!value(out, 0))
+            return false;
+        skipSpace();
+        return p_ == end_;
+    }
+
+private:
+    const char *p_, *end_;
+
+    void skipSpace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r'))
+            p_++;
+    }
+
+    bool literal(const char *word) {
+        size_t n = strlen(word);
+        if ((size_t)(end_ - p_) < n || memcmp(p_, word, n))
+            return false;
+        p_ += n;
+        return true;
+    }
+
+    bool value(Json &out, int depth) {
+        if (depth > 64)
+            return false;
+        skipSpace();
+        if (p_ == end_)
+            return false;
+        switch (*p_) {
+        case '{': return object(out, depth);
+        case '[': return array(out, depth);
+        case '"': out.type = Json::String; return string(out.s);
+        case 't': out.type = Json::Bool; out.b = true; return literal("true");
+        case 'f': out.type = Json::Bool; return literal("false");
+        case 'n': return literal("null");
+        default:  return number(out);
+        }
+    }
+
+    bool object(Json &out, int depth) {
+        out.type = Json::Object;
+        p_++;
+        skipSpace();
+        if (p_ < end_ && *p_ == '}') {
+            p_++;
+            return true;
+        }
+        for (;;) {
+            std::string key;
+            Json v;
+            skipSpace();
+            if (p_ == end_ || *p_ != '"' || !string(key))
+                return false;
+            skipSpace();
+            if (p_ == end_ || *p_++ != ':' || !value(v, depth + 1))
+                return false;
+            out.fields.emplace_back(std::move(key), std::move(v));
+            skipSpace();
+            if (p_ == end_)
+                return false;
+            if (*p_ == '}') {
+                p_++;
+                return true;
+            }
+            if (*p_++ != ',')
+                return false;
+        }
+    }
+
+    bool array(Json &out, int depth) {
+        out.type = Json::Array;
+        p_++;
+        skipSpace();
+        if (p_ < end_ && *p_ == ']') {
+            p_++;
+            return true;
+        }
+        for (;;) {
+            out.items.emplace_back();
+            if (!value(out.items.back(), depth + 1))
+                return false;
+            skipSpace();
+            if (p_ == end_)
+                return false;
+            if (*p_ == ']') {
+                p_++;
+                return true;
+            }
+            if (*p_++ != ',')
+                return false;
+        }
+    }
+
+    static void putUtf8(std::string &s, unsigned cp) {
+        if (cp < 0x80) {
+            s += (char)cp;
+        } else if (cp < 0x800) {
+            s += (char)(0xc0 | cp >> 6);
+            s += (char)(0x80 | (cp & 0x3f));
+        } else if (cp < 0x10000) {
+            s += (char)(0xe0 | cp >> 12);
+            s += (char)(0x80 | (cp >> 6 & 0x3f));
+            s += (char)(0x80 | (cp & 0x3f));
+        } else {
+            s += (char)(0xf0 | cp >> 18);
+            s += (char)(0x80 | (cp >> 12 & 0x3f));
+            s += (char)(0x80 | (cp >> 6 & 0x3f));
+            s += (char)(0x80 | (cp & 0x3f));
+        }
+    }
+
+    bool hex4(unsigned &cp) {
+        if (end_ - p_ < 4)
+            return false;
+        cp = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = *p_++;
+            cp <<= 4;
+            if (c >= '0' && c <= '9')
+                cp |= c - '0';
+            else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                cp |= (c | 0x20) - 'a' + 10;
+            else
+                return false;
+        }
+        return true;
+    }
+
+    bool string(std::string &out) {
+        p_++;
+        while (p_ < end_) {
+            char c = *p_++;
+            if (c == '"')
+                return true;
+            if ((unsigned char)c < 0x20)
+                return false;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (p_ == end_)
+                return false;
+            switch (*p_++) {
+            case '"':  out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/':  out += '/'; break;
+            case 'b':  out += '\b'; break;
+            case 'f':  out += '\f'; break;
+            case 'n':  out += '\n'; break;
+            case 'r':  out += '\r'; break;
+            case 't':  out += '\t'; break;
+            case 'u': {
+                unsigned cp, lo;
+                if (!hex4(cp))
+                    return false;
+                if (cp >= 0xd800 && cp < 0xdc00 && end_ - p_ >= 6 && p_[0] == '\\' &&
+                    p_[1] == 'u') {
+                    const char *save = p_;
+                    p_ += 2;
+                    if (hex4(lo) && lo >= 0xdc00 && lo < 0xe000)
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    else
+                        p_ = save;
+                }
+                putUtf8(out, cp);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool number(Json &out) {
+        const char *start = p_;
+        if (p_ < end_ && *p_ == '-')
+            p_++;
+        if (p_ == end_ || *p_ < '0' || *p_ > '9')
+            return false;
+        if (*p_ == '0')
+            p_++;
+        else
+            while (p_ < end_ && *p_ >= '0' && *p_ <= '9')
+                p_++;
+        if (p_ < end_ && *p_ == '.') {
+            p_++;
+            if (p_ == end_ || *p_ < '0' || *p_ > '9')
+                return false;
+            while (p_ < end_ && *p_ >= '0' && *p_ <= '9')
+                p_++;
+        }
+        if (p_ < end_ && (*p_ | 0x20) == 'e') {
+            p_++;
+            if (p_ < end_ && (*p_ == '+' || *p_ == '-'))
+                p_++;
+            if (p_ == end_ || *p_ < '0' || *p_ > '9')
+                return false;
+            while (p_ < end_ && *p_ >= '0' && *p_ <= '9')
+                p_++;
+        }
+        out.type = Json::Number;
+        out.s.assign(start, p_);
+        return true;
+    }
+};
+
+// int(x, 0): only strings; anything else is a TypeError
+std::optional<Int> jsonIntBase0(const Json *j) {
+    if (!j)
+        return std::nullopt;
+    if (j->type != Json::String)
+        throw PyError{"int() can't convert non-string with explicit base"};
+    return parsePyInt(j->s, true);
+}
+
+// int(x): integers, truncated floats, decimal strings and booleans
+std::optional<Int> jsonInt(const Json *j) {
+    if (!j)
+        return std::nullopt;
+    switch (j->type) {
+    case Json::Bool:
+        return Int(j->b);
+    case Json::String:
+        return parsePyInt(j->s, false);
+    case Json::Number:
+        if (j->s.find_first_of(".eE") == std::string::npos)
+            return parsePyInt(j->s, false);
+        else {
+            double d = std::trunc(strtod(j->s.c_str(), nullptr));
+            if (!std::isfinite(d))
+                return std::nullopt;
+            return d > 1e24 ? kIntClamp : d < -1e24 ? -kIntClamp : Int(d);
+        }
+    default:
+        throw PyError{std::string("int() argument must be a string, a bytes-like object or a "
+                                  "real number, not '") +
+                      (j->type == Json::Null ? "NoneType" : j->type == Json::Array ? "list"
+                                                                                    : "dict") +
+                      "'"};
+    }
+}
+
+void jsonString(std::string &out, std::string_view s) {
+    out += '"';
+    for (char c : s) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+// ---- HTTP request and the API ----
+
+struct Request {
+    std::string_view method;
+    std::string_view path;
+    std::vector<std::pair<std::string, std::string>> query;
+    std::string_view body;
+
+    // request.args.get(): the first value, nullopt when absent
+    std::optional<std::string> arg(std::string_view name) const {
+        for (auto &kv : query)
+            if (kv.first == name)
+                return kv.second;
+        return std::nullopt;
+    }
+
+    // get_json(force=True); silent returns a null Json instead of failing
+    Json json(bool silent = false) const {
+        Json j;
+        if (!JsonParser(body).parse(j)) {
+            if (silent)
+                return Json();
+            fail(400, "The browser (or proxy) sent a request that this server could not understand.");
+        }
+        return j;
+    }
+};
+
+std::string urlDecode(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '+') {
+            out += ' ';
+        } else if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) &&
+                   isxdigit((unsigned char)s[i + 2])) {
+            out += (char)strtol(std::string(s.substr(i + 1, 2)).c_str(), nullptr, 16);
+            i += 2;
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+void parseQuery(std::string_view q, Request &req) {
+    while (!q.empty()) {
+        size_t amp = q.find('&');
+        std::string_view part = q.substr(0, amp);
+        q = amp == std::string_view::npos ? std::string_view() : q.substr(amp + 1);
+        if (part.empty())
+            continue;
+        size_t eq = part.find('=');
+        if (eq == std::string_view::npos)
+            req.query.emplace_back(urlDecode(part), std::string());
+        else
+            req.query.emplace_back(urlDecode(part.substr(0, eq)), urlDecode(part.substr(eq + 1)));
+    }
+}
+
+/*
+ * The /api/v1 handlers. Each mirrors its Flask route, including the order
+ * of its checks and messages; replies list keys sorted, as jsonify() does.
+ */
+class Api {
+public:
+    Api(const Config &cfg, RegImage &img)
+        : base_(cfg.base), size_(cfg.size), end_(Int(cfg.base) + cfg.size - 1),
+          syncAlways_(cfg.sync == SyncMode::Always), img_(img) {}
+
+    struct Route {
+        const char *path;
+        bool post;
+        std::string (Api::*fn)(const Request &);
+    };
+    static const Route routes[];
+
+private:
+    uint64_t base_, size_;
+    Int end_;
+    bool syncAlways_;
+    RegImage &img_;
+
+    void check(Int addr, Int width) const {
+        if (width != 1 && width != 2 && width != 4 && width != 8)
+            fail(400, "bad width (must be 1,2,4,8)");
+        if (addr < Int(base_) || addr + width - 1 > end_)
+            fail(403, "address out of allowed range");
+        if ((addr - base_) % width != 0)
+            fail(400, "misaligned address (must be aligned to width)");
+    }
+
+    /*
+     * addr_sequence_from_start_end_or_count() as (first offset, count).
+     * Checking the first and last address covers every one in between.
+     */
+    std::pair<size_t, size_t> sequence(Int start, std::optional<Int> end,
+                                       std::optional<Int> count, Int width) const {
+        if (count) {
+            if (*count <= 0)
+                fail(400, "count must be >= 1");
+            end = start + width * (*count - 1);
+        }
+        if (!end)
+            fail(400, "either end or count must be provided");
+        if (*end < start)
+            fail(400, "end must be >= start");
+        check(start, width);
+        Int n = (*end - start) / width + 1;
+        check(start + (n - 1) * width, width);
+        return {size_t(start - base_), size_t(n)};
+    }
+
+    uint64_t load(size_t off, unsigned width) const {
+        const uint8_t *p = img_.data() + off;
+        uint64_t v = 0;
+        for (unsigned i = width; i--;)
+            v = v << 8 | p[i];
+        return v;
+    }
+
+    void store(size_t off, unsigned width, uint64_t v) {
+        uint8_t *p = img_.data() + off;
+        for (unsigned i = 0; i < width; i++, v >>= 8)
+            p[i] = (uint8_t)v;
+    }
+
+    bool zero(size_t off, size_t len) const {
+        const uint8_t *p = img_.data() + off;
+        return std::all_of(p, p + len, [](uint8_t b) { return b == 0; });
+    }
+
+    // After a change: record it for the flusher, or write it back now
+    void changed(size_t off, size_t len) {
+        if (syncAlways_)
+            img_.sync(off, len);
+        else
+            img_.markDirty(off, len);
+    }
+
+    static Int intArg(const std::optional<std::string> &s, const char *msg) {
+        auto v = parsePyInt(*s, true);
+        if (!v)
+            fail(400, msg);
+        return *v;
+    }
+
+    static bool fits(Int value, Int width) {
+        return value >= 0 && (width == 8 || value < (Int(1) << (8 * width)));
+    }
+
+    std::string read(const Request &req) {
+        auto addrS = req.arg("addr");
+        auto widthS = req.arg("width").value_or("4");
+        if (!addrS || addrS->empty())
+            fail(400, "addr parameter required");
+        auto addr = parsePyInt(*addrS, true);
+        auto width = parsePyInt(widthS, true);
+        if (!addr || !width)
+            fail(400, "addr/width must be integers (use 0x... for hex)");
+        check(*addr, *width);
+
+        uint64_t val;
+        {
+            std::shared_lock<std::shared_mutex> g(img_.lock());
+            val = load(size_t(*addr - base_), unsigned(*width));
+        }
+        return "{\"addr\":\"" + hex(*addr) + "\",\"value\":\"" + hex(val) +
+               "\",\"width\":" + std::to_string((int)*width) + "}";
+    }
+
+    std::string write(const Request &req) {
+        Json j = req.json();
+        if (!j.truthy())
+            fail(400, "JSON body required");
+        // converted in order, so the first bad field decides 400 or 500
+        const char *bad = "JSON must contain addr, width, value (addr/value can be hex)";
+        auto addr = jsonIntBase0(j.get("addr"));
+        if (!addr)
+            fail(400, bad);
+        auto width = jsonInt(j.get("width"));
+        if (!width)
+            fail(400, bad);
+        auto value = jsonIntBase0(j.get("value"));
+        if (!value)
+            fail(400, bad);
+        check(*addr, *width);
+        size_t off = size_t(*addr - base_);
+        {
+            std::unique_lock<std::shared_mutex> g(img_.lock());
+            if (!zero(off, size_t(*width)))
+                fail(403, "existing value is non-zero; clear before writing");
+            if (!fits(*value, *width))
+                fail(400, "value too large for given width");
+            store(off, unsigned(*width), uint64_t(*value));
+        }
+        changed(off, size_t(*width));
+        return "{\"addr\":\"" + hex(*addr) + "\",\"status\":\"ok\",\"value\":\"" + hex(*value) +
+               "\",\"width\":" + std::to_string((int)*width) + "}";
+    }
+
+    std::string readRange(const Request &req) {
+        auto startS = req.arg("start");
+        auto endS = req.arg("end");
+        auto countS = req.arg("count");
+        auto widthS = req.arg("width").value_or("4");
+        if (!startS || startS->empty())
+            fail(400, "start parameter required");
+        auto start = parsePyInt(*startS, true);
+        auto width = parsePyInt(widthS, true);
+        if (!start || !width)
+            fail(400, "start/width must be integers");
+        std::optional<Int> end, count;
+        if (endS && !endS->empty())
+            end = intArg(endS, "end must be integer");
+        if (countS && !countS->empty())
+            count = intArg(countS, "count must be integer");
+        auto [off, n] = sequence(*start, end, count, *width);
+        unsigned w = unsigned(*width);
+
+        std::string out;
+        out.reserve(64 + n * 28);
+        out += "{\"count\":" + std::to_string(n) + ",\"data\":{";
+        {
+            std::shared_lock<std::shared_mutex> g(img_.lock());
+            for (size_t i = 0; i < n; i++) {
+                if (i)
+                    out += ',';
+                out += '"';
+                out += hex(Int(base_) + off + i * w);
+                out += "\":\"";
+                out += hex(load(off + i * w, w));
+                out += '"';
+            }
+        }
+        out += "},\"status\":\"ok\",\"width\":" + std::to_string(w) + "}";
+        return out;
+    }
+
+    std::string writeRange(const Request &req) {
+        Json j = req.json();
+        if (!j.truthy())
+            fail(400, "JSON body required");
+        const char *bad = "JSON must contain start (hex), count (int), optional width (int)";
+        auto start = jsonIntBase0(j.get("start"));
+        if (!start)
+            fail(400, bad);
+        auto count = jsonInt(j.get("count"));
+        if (!count)
+            fail(400, bad);
+        std::optional<Int> width = Int(4);
+        if (j.get("width"))
+            width = jsonInt(j.get("width"));
+        if (!width)
+            fail(400, bad);
+        auto [off, n] = sequence(*start, std::nullopt, count, *width);
+        unsigned w = unsigned(*width);
+
+        std::vector<Int> values;
+        if (const Json *vs = j.get("values")) {
+            if (vs->type != Json::Array)
+                fail(400, "values must be a list");
+            if (vs->items.size() != n)
+                fail(400, "values list length must equal count");
+            values.reserve(n);
+            for (auto &item : vs->items) {
+                auto v = jsonIntBase0(&item);
+                if (!v)
+                    fail(400, "values must be integers (hex ok)");
+                values.push_back(*v);
+            }
+        } else if (const Json *v = j.get("value")) {
+            auto one = jsonIntBase0(v);
+            if (!one)
+                fail(400, "value must be integer");
+            values.assign(n, *one);
+        } else {
+            fail(400, "provide either 'values' list or single 'value'");
+        }
+
+        {
+            std::unique_lock<std::shared_mutex> g(img_.lock());
+            std::string offending;
+            for (size_t i = 0; i < n; i++) {
+                if (!zero(off + i * w, w)) {
+                    if (!offending.empty())
+                        offending += ',';
+                    offending += hex(Int(base_) + off + i * w);
+                }
+            }
+            if (!offending.empty())
+                fail(403, "existing non-zero at addresses: " + offending);
+            // all values are checked first, so a bad one leaves nothing half-written
+            for (size_t i = 0; i < n; i++) {
+                if (!fits(values[i], w)) {
+                    char num[48];
+                    Int v = values[i] < 0 ? -values[i] : values[i];
+                    snprintf(num, sizeof(num), "%s%llu", values[i] < 0 ? "-" : "",
+                             (unsigned long long)v);
+                    if (v >= (Int(1) << 64))
+                        snprintf(num, sizeof(num), "%s", hex(values[i]).c_str());
+                    fail(400, std::string("value ") + num + " too large for width " +
+                                  std::to_string(w) + " at addr " +
+                                  hex(Int(base_) + off + i * w));
+                }
+            }
+            for (size_t i = 0; i < n; i++)
+                store(off + i * w, w, uint64_t(values[i]));
+        }
+        changed(off, n * w);
+
+        std::string out;
+        out.reserve(64 + n * 48);
+        out += "{\"count\":" + std::to_string(n) + ",\"status\":\"ok\",\"written\":[";
+        for (size_t i = 0; i < n; i++) {
+            if (i)
+                out += ',';
+            out += "{\"addr\":\"" + hex(Int(base_) + off + i * w) + "\",\"value\":\"" +
+                   hex(values[i]) + "\"}";
+        }
+        out += "]}";
+        return out;
+    }
+
+    std::string clear(const Request &req) {
+        auto addrS = req.arg("addr");
+        auto widthS = req.arg("width").value_or("4");
+        if (!addrS || addrS->empty())
+            fail(400, "addr parameter required");
+        auto addr = parsePyInt(*addrS, true);
+        auto width = parsePyInt(widthS, true);
+        if (!addr || !width)
+            fail(400, "addr/width must be integers");
+        check(*addr, *width);
+        size_t off = size_t(*addr - base_);
+        {
+            std::unique_lock<std::shared_mutex> g(img_.lock());
+            memset(img_.data() + off, 0, size_t(*width));
+        }
+        changed(off, size_t(*width));
+        return "{\"addr\":\"" + hex(*addr) + "\",\"status\":\"cleared\",\"value\":\"0x0\",\"width\":" +
+               std::to_string((int)*width) + "}";
+    }
+
+    std::string clearRange(const Request &req) {
+        Json j = req.json();
+        const char *bad = "JSON must contain start,end,width";
+        auto start = jsonIntBase0(j.get("start"));
+        if (!start)
+            fail(400, bad);
+        auto end = jsonIntBase0(j.get("end"));
+        if (!end)
+            fail(400, bad);
+        std::optional<Int> width = Int(4);
+        if (j.get("width"))
+            width = jsonInt(j.get("width"));
+        if (!width)
+            fail(400, bad);
+        if (*end < *start)
+            fail(400, "end must be >= start");
+        auto [off, n] = sequence(*start, end, std::nullopt, *width);
+        size_t len = n * size_t(*width);
+        {
+            std::unique_lock<std::shared_mutex> g(img_.lock());
+            memset(img_.data() + off, 0, len);
+        }
+        changed(off, len);
+        return "{\"count\":" + std::to_string(n) + ",\"end\":\"" + hex(*end) + "\",\"start\":\"" +
+               hex(*start) + "\",\"status\":\"cleared_range\",\"width\":" +
+               std::to_string((int)*width) + "}";
+    }
+
+    std::string clearAll(const Request &req) {
+        Json j = req.json(true);
+        const Json *confirm = j.get("confirm");
+        if (!confirm || confirm->type != Json::Bool || !confirm->b)
+            fail(400, "must POST JSON {\"confirm\": true} to clear all");
+        {
+            std::unique_lock<std::shared_mutex> g(img_.lock());
+            memset(img_.data(), 0, size_);
+        }
+        changed(0, size_);
+        return "{\"base\":\"" + hex(Int(base_)) + "\",\"size\":" + std::to_string(size_) +
+               ",\"status\":\"cleared_all\"}";
+    }
+};
+
+const Api::Route Api::routes[] = {
+    { "/api/v1/read",        false, &Api::read },
+    { "/api/v1/write",       true,  &Api::write },
+    { "/api/v1/read_range",  false, &Api::readRange },
+    { "/api/v1/write_range", true,  &Api::writeRange },
+    { "/api/v1/clear",       false, &Api::clear },
+    { "/api/v1/clear_range", true,  &Api::clearRange },
+    { "/api/v1/clear_all",   true,  &Api::clearAll },
+};
+
+const char *reason(int code) {
+    switch (code) {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Request Entity Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    default:  return "Unknown";
+    }
+}
+
+std::string errorBody(int code, std::string_view message) {
+    std::string out = "{\"error\":";
+    jsonString(out, reason(code));
+    out += ",\"message\":";
+    jsonString(out, message);
+    out += '}';
+    return out;
+}
+
+// ---- connections ----
+
+struct Conn {
+    int fd = -1;
+    SSL *ssl = nullptr;
+    std::string in;             // received bytes not yet parsed
+    std::string out;            // reply bytes not yet sent
+    size_t outPos = 0;
+    bool closeAfter = false;    // close once out is drained
+    bool sentContinue = false;  // "100 Continue" sent for the pending request
+    bool sslWantsWrite = false;
+    uint32_t events = 0;        // current epoll interest
+
+    size_t pending() const { return out.size() - outPos; }
+};
+
+bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(),
+                      [](char x, char y) { return tolower((unsigned char)x) == tolower((unsigned char)y); });
+}
+
+bool containsToken(std::string_view list, std::string_view token) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view t = list.substr(0, comma);
+        while (!t.empty() && t.front() == ' ')
+            t.remove_prefix(1);
+        while (!t.empty() && t.back() == ' ')
+            t.remove_suffix(1);
+        if (iequals(t, token))
+            return true;
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+    }
+    return false;
+}
+
+class Worker {
+public:
+    Worker(const Config &cfg, Api &api, SSL_CTX *ctx) : cfg_(cfg), api_(api), ctx_(ctx) {}
+
+    bool listen() {
+        sockaddr_in sa{};
+        int one = 1;
+
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons(cfg_.port);
+        if (inet_pton(AF_INET, cfg_.host.c_str(), &sa.sin_addr) != 1) {
+            fprintf(stderr, "bad listen address %s\n", cfg_.host.c_str());
+            return false;
+        }
+        lfd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        ep_ = epoll_create1(EPOLL_CLOEXEC);
+        if (lfd_ < 0 || ep_ < 0 ||
+            setsockopt(lfd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+            setsockopt(lfd_, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) ||
+            bind(lfd_, (sockaddr *)&sa, sizeof(sa)) || ::listen(lfd_, SOMAXCONN)) {
+            perror("listen");
+            return false;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        return epoll_ctl(ep_, EPOLL_CTL_ADD, lfd_, &ev) == 0;
+    }
+
+    void run() {
+        epoll_event evs[256];
+
+        while (!stopping.load(std::memory_order_relaxed)) {
+            int n = epoll_wait(ep_, evs, 256, 500);
+            for (int i = 0; i < n; i++) {
+                auto *c = static_cast<Conn *>(evs[i].data.ptr);
+                if (!c)
+                    accept();
+                else if ((evs[i].events & (EPOLLERR | EPOLLHUP)) || !pump(*c))
+                    drop(c);
+                else
+                    watch(*c);
+            }
+        }
+    }
+
+    ~Worker() {
+        for (Conn *c : conns_)
+            drop(c, false);
+        if (lfd_ >= 0)
+            close(lfd_);
+        if (ep_ >= 0)
+            close(ep_);
+    }
+
+private:
+    const Config &cfg_;
+    Api &api_;
+    SSL_CTX *ctx_;
+    int lfd_ = -1, ep_ = -1;
+    std::vector<Conn *> conns_;
+
+    void accept() {
+        for (;;) {
+            int fd = accept4(lfd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+                return;
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            auto *c = new Conn;
+            c->fd = fd;
+            if (ctx_) {
+                c->ssl = SSL_new(ctx_);
+                if (!c->ssl || !SSL_set_fd(c->ssl, fd)) {
+                    drop(c, false);
+                    continue;
+                }
+                SSL_set_accept_state(c->ssl);
+            }
+            epoll_event ev{};
+            ev.events = c->events = EPOLLIN;
+            ev.data.ptr = c;
+            if (epoll_ctl(ep_, EPOLL_CTL_ADD, fd, &ev)) {
+                drop(c, false);
+                continue;
+            }
+            conns_.push_back(c);
+        }
+    }
+
+    void drop(Conn *c, bool listed = true) {
+        if (listed)
+            conns_.erase(std::find(conns_.begin(), conns_.end(), c));
+        if (c->ssl) {
+            SSL_shutdown(c->ssl);
+            SSL_free(c->ssl);
+        }
+        close(c->fd);       // also removes it from the epoll set
+        delete c;
+    }
+
+    // Interest follows state: no reads while replies back up or when closing
+    void watch(Conn &c) {
+        uint32_t want = 0;
+        if (!c.closeAfter && c.pending() < kMaxOut)
+            want |= EPOLLIN;
+        if (c.pending() || c.sslWantsWrite)
+            want |= EPOLLOUT;
+        if (want == c.events)
+            return;
+        epoll_event ev{};
+        ev.events = c.events = want;
+        ev.data.ptr = &c;
+        epoll_ctl(ep_, EPOLL_CTL_MOD, c.fd, &ev);
+    }
+
+    // 1 data read, 0 would block, -1 end of stream, -2 error
+    int readSome(Conn &c) {
+        char buf[16384];
+
+        c.sslWantsWrite = false;
+        if (!c.ssl) {
+            ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                c.in.append(buf, n);
+                return 1;
+            }
+            if (n == 0)
+                return -1;
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -2;
+        }
+        int n = SSL_read(c.ssl, buf, sizeof(buf));
+        if (n > 0) {
+            c.in.append(buf, n);
+            return 1;
+        }
+        switch (SSL_get_error(c.ssl, n)) {
+        case SSL_ERROR_WANT_READ:
+            return 0;
+        case SSL_ERROR_WANT_WRITE:
+            c.sslWantsWrite = true;
+            return 0;
+        case SSL_ERROR_ZERO_RETURN:
+            return -1;
+        default:
+            ERR_clear_error();
+            return -2;
+        }
+    }
+
+    bool flush(Conn &c) {
+        while (c.pending()) {
+            const char *p = c.out.data() + c.outPos;
+            size_t len = c.pending();
+            if (!c.ssl) {
+                ssize_t n = send(c.fd, p, len, MSG_NOSIGNAL);
+                if (n < 0)
+                    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                c.outPos += n;
+                continue;
+            }
+            int n = SSL_write(c.ssl, p, (int)std::min<size_t>(len, INT_MAX));
+            if (n <= 0) {
+                int err = SSL_get_error(c.ssl, n);
+                if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ)
+                    return true;
+                ERR_clear_error();
+                return false;
+            }
+            c.outPos += n;
+        }
+        c.out.clear();
+        c.outPos = 0;
+        return true;
+    }
+
+    // Returns false when the connection should be closed
+    bool pump(Conn &c) {
+        for (;;) {
+            if (!flush(c))
+                return false;
+            if (c.closeAfter)
+                return c.pending() != 0;
+            if (c.pending() >= kMaxOut)
+                return true;
+            int r = readSome(c);
+            if (r == 0)
+                return true;
+            if (r == -2)
+                return false;
+            process(c);
+            if (r == -1)
+                c.closeAfter = true;    // answer what arrived, then close
+        }
+    }
+
+    void reply(Conn &c, int code, const std::string &body, bool keepAlive, bool head,
+               const char *allow = nullptr) {
+        char hdr[256];
+        int n = snprintf(hdr, sizeof(hdr),
+                         "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+                         "Content-Length: %zu\r\n%s%s%sConnection: %s\r\n\r\n",
+                         code, reason(code), body.size() + 1, allow ? "Allow: " : "",
+                         allow ? allow : "", allow ? "\r\n" : "", keepAlive ? "keep-alive" : "close");
+        c.out.append(hdr, n);
+        if (!head) {
+            c.out += body;
+            c.out += '\n';
+        }
+        if (!keepAlive)
+            c.closeAfter = true;
+    }
+
+    // Answer every complete request in c.in
+    void process(Conn &c) {
+        size_t pos = 0;
+
+        while (!c.closeAfter) {
+            std::string_view in(c.in);
+            in.remove_prefix(pos);
+            size_t he = in.find("\r\n\r\n");
+            if (he == std::string_view::npos) {
+                if (in.size() > kMaxHeader)
+                    reply(c, 431, errorBody(431, "request header too large"), false, false);
+                break;
+            }
+            if (he > kMaxHeader) {
+                reply(c, 431, errorBody(431, "request header too large"), false, false);
+                break;
+            }
+
+            std::string_view head = in.substr(0, he);
+            size_t eol = head.find("\r\n");
+            std::string_view line = head.substr(0, eol);
+            size_t sp1 = line.find(' '), sp2 = line.rfind(' ');
+            if (sp1 == std::string_view::npos || sp1 == sp2) {
+                reply(c, 400, errorBody(400, "malformed request line"), false, false);
+                break;
+            }
+            Request req;
+            req.method = line.substr(0, sp1);
+            std::string_view target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+            std::string_view version = line.substr(sp2 + 1);
+            bool http11 = version == "HTTP/1.1";
+            if (!http11 && version != "HTTP/1.0") {
+                reply(c, 400, errorBody(400, "unsupported HTTP version"), false, false);
+                break;
+            }
+
+            bool keepAlive = http11, expect = false, chunked = false;
+            size_t length = 0;
+            std::string_view hdrs = eol == std::string_view::npos ? "" : head.substr(eol + 2);
+            bool bad = false;
+            while (!hdrs.empty()) {
+                size_t e = hdrs.find("\r\n");
+                std::string_view h = hdrs.substr(0, e);
+                hdrs = e == std::string_view::npos ? std::string_view() : hdrs.substr(e + 2);
+                size_t colon = h.find(':');
+                if (colon == std::string_view::npos) {
+                    bad = true;
+                    break;
+                }
+                std::string_view name = h.substr(0, colon), value = h.substr(colon + 1);
+                while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+                    value.remove_prefix(1);
+                while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+                    value.remove_suffix(1);
+                if (iequals(name, "content-length")) {
+                    auto v = parsePyInt(value, false);
+                    if (!v || *v < 0) {
+                        bad = true;
+                        break;
+                    }
+                    length = *v > Int(SIZE_MAX / 2) ? SIZE_MAX / 2 : size_t(*v);
+                } else if (iequals(name, "connection")) {
+                    if (containsToken(value, "close"))
+                        keepAlive = false;
+                    else if (containsToken(value, "keep-alive"))
+                        keepAlive = true;
+                } else if (iequals(name, "transfer-encoding")) {
+                    chunked = true;
+                } else if (iequals(name, "expect")) {
+                    expect = iequals(value, "100-continue");
+                }
+            }
+            if (bad) {
+                reply(c, 400, errorBody(400, "malformed header"), false, false);
+                break;
+            }
+            if (chunked) {
+                reply(c, 501, errorBody(501, "chunked request bodies are not supported"), false,
+                      false);
+                break;
+            }
+            if (length > kMaxBody) {
+                reply(c, 413, errorBody(413, "request body too large"), false, false);
+                break;
+            }
+            if (in.size() - he - 4 < length) {
+                if (expect && http11 && !c.sentContinue) {
+                    c.out += "HTTP/1.1 100 Continue\r\n\r\n";
+                    c.sentContinue = true;
+                }
+                break;
+            }
+            c.sentContinue = false;
+            req.body = in.substr(he + 4, length);
+            pos += he + 4 + length;
+
+            size_t qm = target.find('?');
+            req.path = target.substr(0, qm);
+            if (qm != std::string_view::npos)
+                parseQuery(target.substr(qm + 1), req);
+            dispatch(c, req, keepAlive);
+        }
+        c.in.erase(0, pos);
+    }
+
+    void dispatch(Conn &c, const Request &req, bool keepAlive) {
+        const Api::Route *route = nullptr;
+        for (auto &r : Api::routes)
+            if (req.path == r.path)
+                route = &r;
+        if (!route) {
+            reply(c, 404, errorBody(404, "The requested URL was not found on the server. If you "
+                                         "entered the URL manually please check your spelling and "
+                                         "try again."),
+                  keepAlive, req.method == "HEAD");
+            return;
+        }
+
+        const char *allow = route->post ? "OPTIONS, POST" : "GET, HEAD, OPTIONS";
+        bool head = req.method == "HEAD" && !route->post;
+        if (req.method == "OPTIONS") {
+            char hdr[160];
+            int n = snprintf(hdr, sizeof(hdr),
+                             "HTTP/1.1 200 OK\r\nAllow: %s\r\nContent-Length: 0\r\n"
+                             "Connection: %s\r\n\r\n",
+                             allow, keepAlive ? "keep-alive" : "close");
+            c.out.append(hdr, n);
+            c.closeAfter |= !keepAlive;
+            return;
+        }
+        if (req.method != (route->post ? "POST" : "GET") && !head) {
+            reply(c, 405, errorBody(405, "The method is not allowed for the requested URL."),
+                  keepAlive, false, allow);
+            return;
+        }
+
+        try {
+            reply(c, 200, (api_.*route->fn)(req), keepAlive, head);
+        } catch (const HttpError &e) {
+            reply(c, e.code, errorBody(e.code, e.message), keepAlive, head);
+        } catch (const PyError &e) {
+            // the Python body also carries a "trace" with the traceback
+            std::string body = "{\"error\":\"InternalServerError\",\"message\":";
+            jsonString(body, e.message);
+            body += '}';
+            reply(c, 500, body, keepAlive, head);
+        } catch (const std::exception &e) {
+            reply(c, 500, errorBody(500, e.what()), keepAlive, head);
+        }
+    }
+};
+
+// ---- setup ----
+
+SSL_CTX *makeTls(const Config &cfg) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx)
+        return nullptr;
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                              SSL_MODE_RELEASE_BUFFERS);
+    if (SSL_CTX_use_certificate_chain_file(ctx, cfg.cert.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, cfg.key.c_str(), SSL_FILETYPE_PEM) != 1) {
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+void onSignal(int) {
+    stopping.store(true);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --port N        listen port (default 8443)\n"
+            "  --host ADDR     listen address (default 0.0.0.0)\n"
+            "  --base ADDR     first register address (default 0x80000000)\n"
+            "  --size BYTES    register space size (default 0x10000)\n"
+            "  --file PATH     backing image (default vreg.bin)\n"
+            "  --cert PATH     server certificate (default certs/server.crt)\n"
+            "  --key PATH      server key (default certs/server.key)\n"
+            "  --plain         plain HTTP instead of TLS\n"
+            "  --threads N     event loops (default: one per CPU)\n"
+            "  --sync MODE     always: msync changed pages before replying;\n"
+            "                  MS: msync dirty pages every MS milliseconds (default 100);\n"
+            "                  none: leave write-back to the kernel until exit\n",
+            prog);
+}
+
+bool parseU64(const char *s, uint64_t &out) {
+    auto v = parsePyInt(s, true);
+    if (!v || *v < 0 || *v > Int(UINT64_MAX))
+        return false;
+    out = uint64_t(*v);
+    return true;
+}
+
+}   // namespace
+
+int main(int argc, char **argv) {
+    static const option longOpts[] = {
+        { "port",    required_argument, nullptr, 'p' },
+        { "host",    required_argument, nullptr, 'H' },
+        { "base",    required_argument, nullptr, 'b' },
+        { "size",    required_argument, nullptr, 's' },
+        { "file",    required_argument, nullptr, 'f' },
+        { "cert",    required_argument, nullptr, 'c' },
+        { "key",     required_argument, nullptr, 'k' },
+        { "plain",   no_argument,       nullptr, 'P' },
+        { "threads", required_argument, nullptr, 't' },
+        { "sync",    required_argument, nullptr, 'S' },
+        { "help",    no_argument,       nullptr, 'h' },
+        { nullptr,   0,                 nullptr, 0 },
+    };
+    Config cfg;
+    uint64_t v;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "h", longOpts, nullptr)) != -1) {
+        switch (opt) {
+        case 'p':
+            if (!parseU64(optarg, v) || !v || v > 65535)
+                goto bad;
+            cfg.port = (int)v;
+            break;
+        case 'H': cfg.host = optarg; break;
+        case 'b':
+            if (!parseU64(optarg, cfg.base))
+                goto bad;
+            break;
+        case 's':
+            if (!parseU64(optarg, cfg.size) || !cfg.size)
+                goto bad;
+            break;
+        case 'f': cfg.file = optarg; break;
+        case 'c': cfg.cert = optarg; break;
+        case 'k': cfg.key = optarg; break;
+        case 'P': cfg.tls = false; break;
+        case 't':
+            if (!parseU64(optarg, v) || !v || v > 1024)
+                goto bad;
+            cfg.threads = (unsigned)v;
+            break;
+        case 'S':
+            if (!strcmp(optarg, "always")) {
+                cfg.sync = SyncMode::Always;
+            } else if (!strcmp(optarg, "none")) {
+                cfg.sync = SyncMode::None;
+            } else if (parseU64(optarg, v) && v && v <= 3600000) {
+                cfg.sync = SyncMode::Interval;
+                cfg.syncMs = (unsigned)v;
+            } else {
+                goto bad;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind != argc)
+        goto bad;
+    if (!cfg.threads)
+        cfg.threads = std::max(1u, std::thread::hardware_concurrency());
+
+    {
+        RegImage img;
+        if (!img.open(cfg.file, cfg.size)) {
+            perror(cfg.file.c_str());
+            return 1;
+        }
+
+        SSL_CTX *ctx = nullptr;
+        if (cfg.tls && !(ctx = makeTls(cfg)))
+            return 1;
+
+        Api api(cfg, img);
+        std::vector<std::unique_ptr<Worker>> workers;
+        for (unsigned i = 0; i < cfg.threads; i++) {
+            workers.push_back(std::make_unique<Worker>(cfg, api, ctx));
+            if (!workers.back()->listen())
+                return 1;
+        }
+
+        struct sigaction sa{};
+        sa.sa_handler = onSignal;
+        sigaction(SIGINT, &sa, nullptr);
+        sigaction(SIGTERM, &sa, nullptr);
+        signal(SIGPIPE, SIG_IGN);
+
+        fprintf(stderr, "serving 0x%llx-0x%llx from %s on %s://%s:%d, %u threads, sync %s\n",
+                (unsigned long long)cfg.base, (unsigned long long)(cfg.base + cfg.size - 1),
+                cfg.file.c_str(), cfg.tls ? "https" : "http", cfg.host.c_str(), cfg.port,
+                cfg.threads,
+                cfg.sync == SyncMode::Always ? "always" :
+                cfg.sync == SyncMode::None ? "none" : (std::to_string(cfg.syncMs) + " ms").c_str());
+
+        std::mutex flushLock;
+        std::condition_variable flushWake;
+        std::thread flusher;
+        if (cfg.sync == SyncMode::Interval) {
+            flusher = std::thread([&] {
+                std::unique_lock<std::mutex> g(flushLock);
+                while (!stopping) {
+                    flushWake.wait_for(g, std::chrono::milliseconds(cfg.syncMs));
+                    img.flushDirty();
+                }
+            });
+        }
+
+        std::vector<std::thread> threads;
+        for (auto &w : workers)
+            threads.emplace_back([&w] { w->run(); });
+        for (auto &t : threads)
+            t.join();
+        workers.clear();
+
+        if (flusher.joinable()) {
+            flushWake.notify_all();
+            flusher.join();
+        }
+        // whatever the policy, nothing is left unwritten on a clean exit
+        img.sync(0, img.size());
+        if (ctx)
+            SSL_CTX_free(ctx);
+    }
+    return 0;
+
+bad:
+    usage(argv[0]);
+    return 1;
+}
@@ -1,29 +1,397 @@
 #!/usr/bin/env python3
 import ssl
 import os
+import bisect
+import ctypes
+import errno
+import json
+import signal
+import struct
+import sys
+import threading
+import time
 import traceback
-from flask import Flask, request, jsonify, abort
+import zlib
+import atexit
+from flask import Flask, Response, request, jsonify, abort, stream_with_context
 from werkzeug.exceptions import HTTPException
 
 # ----- config -----
-BASE = 0x80000000
+BASE = 0x80000000                # default map when REGION_CONFIG is absent
 SIZE = 0x10000
-END = BASE + SIZE - 1
 MEMFILE = "vreg.bin"
+REGION_CONFIG = os.environ.get("VREG_CONFIG", "regions.json")
+PAGE_SIZE = 4096
+WALFILE = "vreg.wal"
+GROUP_COMMIT_WINDOW = 0.0        # seconds to wait for more records before an fsync
+CHECKPOINT_BYTES = 4 << 20       # fold the log into the region files once it reaches this size
+CHECKPOINT_INTERVAL = 30.0       # ... or when it is this many seconds old
+BIN_CHUNK = 1 << 20              # bytes per chunk of a streamed binary range
 
+FALLOC_FL_KEEP_SIZE = 0x01
+FALLOC_FL_PUNCH_HOLE = 0x02
+_libc = ctypes.CDLL(None, use_errno=True)
+_libc.fallocate.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_longlong, ctypes.c_longlong]
 
-if os.path.exists(MEMFILE):
-    with open(MEMFILE, "rb") as f:
-        data = f.read()
-    if len(data) == SIZE:
-        memory = bytearray(data)
-    else:
-        memory = bytearray(SIZE)
-else:
-    memory = bytearray(SIZE)
+
+def punch_hole(fd, offset, length):
+    """Deallocate a file range so it reads as zeros; False if unsupported."""
+    if _libc.fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == 0:
+        return True
+    err = ctypes.get_errno()
+    if err in (errno.EOPNOTSUPP, errno.ENOSYS):
+        return False
+    raise OSError(err, os.strerror(err))
+
+
+class Region:
+    """One block of the register map, held as a sparse table of pages.
+
+    Only pages that were ever written are allocated; everything else reads
+    as zero. The backing file is a sparse file of the region's size, with
+    the same offsets.
+    """
+    def __init__(self, name, base, size, path, access="rw", write_once=True,
+                 widths=(1, 2, 4, 8)):
+        self.name = name
+        self.base = base
+        self.size = size
+        self.end = base + size - 1
+        self.path = path
+        self.writable = access == "rw"
+        self.write_once = write_once
+        self.widths = tuple(widths)
+        self.pages = {}             # page index -> bytearray(PAGE_SIZE)
+        self.dirty = set()          # pages changed since the last checkpoint
+        self.cleared = False        # whole region zeroed since the last checkpoint
+        self.fd = -1
+
+    def open(self):
+        """Open the backing file and load its data pages."""
+        if not self.writable:
+            if not os.path.exists(self.path):
+                return
+            self.fd = os.open(self.path, os.O_RDONLY)
+        else:
+            self.fd = os.open(self.path, os.O_RDWR | os.O_CREAT, 0o644)
+        length = os.fstat(self.fd).st_size
+        if length != self.size:
+            if length:
+                print(f"{self.path}: size {length:#x}, expected {self.size:#x}; starting empty",
+                      file=sys.stderr)
+            if self.writable:
+                os.ftruncate(self.fd, 0)
+                os.ftruncate(self.fd, self.size)
+            return
+        # visit only the allocated extents of the sparse file
+        pos = 0
+        while pos < length:
+            try:
+                pos = os.lseek(self.fd, pos, os.SEEK_DATA)
+            except OSError:
+                break               # no data after pos
+            hole = os.lseek(self.fd, pos, os.SEEK_HOLE)
+            first = pos // PAGE_SIZE
+            for index in range(first, (hole + PAGE_SIZE - 1) // PAGE_SIZE):
+                page = os.pread(self.fd, PAGE_SIZE, index * PAGE_SIZE)
+                if page.count(0) != len(page):
+                    self.pages[index] = bytearray(page.ljust(PAGE_SIZE, b"\0"))
+            pos = (hole + PAGE_SIZE - 1) // PAGE_SIZE * PAGE_SIZE
+
+    def _spans(self, offset, length):
+        """Yield (page index, start in page, end in page, start in data)."""
+        done = 0
+        while done < length:
+            index, start = divmod(offset + done, PAGE_SIZE)
+            n = min(PAGE_SIZE - start, length - done)
+            yield index, start, start + n, done
+            done += n
+
+    def read(self, offset, length):
+        out = bytearray(length)
+        for index, start, end, at in self._spans(offset, length):
+            page = self.pages.get(index)
+            if page is not None:
+                out[at:at + end - start] = page[start:end]
+        return out
+
+    def write(self, offset, data):
+        for index, start, end, at in self._spans(offset, len(data)):
+            page = self.pages.get(index)
+            if page is None:
+                page = self.pages[index] = bytearray(PAGE_SIZE)
+            page[start:end] = data[at:at + end - start]
+            self.dirty.add(index)
+
+    def zero(self, offset, length):
+        if offset == 0 and length == self.size:
+            self.clear()
+            return
+        for index, start, end, at in self._spans(offset, length):
+            page = self.pages.get(index)
+            if page is None:
+                continue
+            if end - start == PAGE_SIZE:
+                del self.pages[index]
+            else:
+                page[start:end] = bytes(end - start)
+            self.dirty.add(index)
+
+    def clear(self):
+        self.pages.clear()
+        self.dirty.clear()
+        self.cleared = True
+
+    def is_zero(self, offset, length):
+        for index, start, end, at in self._spans(offset, length):
+            page = self.pages.get(index)
+            if page is not None and page.count(0, start, end) != end - start:
+                return False
+        return True
+
+    def snapshot(self):
+        """Take the changes since the last checkpoint; call under mem_lock."""
+        pages = {i: bytes(self.pages[i]) if i in self.pages else None for i in self.dirty}
+        cleared = self.cleared
+        self.dirty = set()
+        self.cleared = False
+        return cleared, pages
+
+    def flush(self, cleared, pages):
+        """Write a snapshot() to the backing file and fsync it.
+
+        Pages that are now all zero become holes again, so clearing keeps
+        the file sparse.
+        """
+        if cleared:
+            os.ftruncate(self.fd, 0)
+            os.ftruncate(self.fd, self.size)
+        for index, page in pages.items():
+            offset = index * PAGE_SIZE
+            n = min(PAGE_SIZE, self.size - offset)
+            if page is None or page.count(0) == len(page):
+                if not punch_hole(self.fd, offset, n):
+                    os.pwrite(self.fd, bytes(n), offset)
+            else:
+                os.pwrite(self.fd, page[:n], offset)
+        if cleared or pages:
+            os.fsync(self.fd)
+
+
+class AddressSpace:
+    """The register map: non-overlapping regions looked up by address."""
+    def __init__(self, regions):
+        self.regions = sorted(regions, key=lambda r: r.base)
+        self.bases = [r.base for r in self.regions]
+        for a, b in zip(self.regions, self.regions[1:]):
+            if b.base <= a.end:
+                raise ValueError(f"regions {a.name} and {b.name} overlap")
+
+    def find(self, addr, length=1):
+        """Region holding [addr, addr + length), or None."""
+        i = bisect.bisect_right(self.bases, addr) - 1
+        if i < 0:
+            return None
+        r = self.regions[i]
+        return r if addr + length - 1 <= r.end else None
+
+    def open(self):
+        for r in self.regions:
+            r.open()
+
+    def snapshot(self):
+        return [(r, r.snapshot()) for r in self.regions if r.writable]
+
+    def flush(self, snapshot):
+        for r, (cleared, pages) in snapshot:
+            r.flush(cleared, pages)
+
+
+def load_regions(path):
+    """Regions from a JSON config, or the single default region.
+
+    {"regions": [{"name": "ddr", "base": "0x80000000", "size": "0x40000000",
+                  "file": "ddr.bin", "access": "rw", "write_once": true,
+                  "widths": [4, 8]}, ...]}
+    base and size may be hex strings; access is "rw" or "ro" (served from
+    file, never written); write_once and widths default to true and all.
+    """
+    if not os.path.exists(path):
+        return [Region("default", BASE, SIZE, MEMFILE)]
+    with open(path) as f:
+        config = json.load(f)
+    num = lambda v: int(v, 0) if isinstance(v, str) else int(v)
+    regions = []
+    for entry in config["regions"]:
+        name = entry["name"]
+        access = entry.get("access", "rw")
+        widths = entry.get("widths", [1, 2, 4, 8])
+        base, size = num(entry["base"]), num(entry["size"])
+        if access not in ("rw", "ro") or not set(widths) <= {1, 2, 4, 8} or base < 0 or size <= 0:
+            raise ValueError(f"region {name}: bad base, size, access or widths")
+        regions.append(Region(name, base, size, entry.get("file", name + ".bin"), access,
+                              bool(entry.get("write_once", True)), widths))
+    if not regions:
+        raise ValueError("no regions configured")
+    return regions
+
+
+space = AddressSpace(load_regions(REGION_CONFIG))
+space.open()
 
 app = Flask(__name__)
 
+class WriteAheadLog:
+    """Append-only log of memory changes with group commit.
+
+    Handlers change the address space and append a record under mem_lock,
+    then wait() until a commit thread has written and fsynced it; one fsync
+    covers every record queued meanwhile. A checkpoint writes the changed
+    pages to the region files; recover() replays the log over them after
+    a crash.
+
+    Record: <address u64, length u64, kind u32>, length data bytes for SET
+    (none for ZERO), then the crc32 of both. A torn or corrupt tail ends
+    the log. A sound record outside the configured regions (the config
+    changed since it was written) stops startup with the log left as is.
+    """
+    HEADER = struct.Struct("<QQI")
+    CRC = struct.Struct("<I")
+    SET, ZERO = 0, 1
+
+    def __init__(self, path, space, lock):
+        self.path = path
+        self.space = space
+        self.lock = lock
+        self.cond = threading.Condition()
+        self.pending = []           # encoded records not yet written
+        self.seq = 0                # records appended
+        self.durable = 0            # records fsynced (or checkpointed)
+        self.error = None
+        self.stopping = False
+        self.fd = os.open(path, os.O_RDWR | os.O_CREAT | os.O_APPEND, 0o644)
+        self.size = 0
+        self.last_checkpoint = time.monotonic()
+        self.thread = threading.Thread(target=self._run, name="wal-commit", daemon=True)
+
+    def recover(self):
+        """Replay the log and cut off a torn tail; returns records applied."""
+        data = os.pread(self.fd, os.fstat(self.fd).st_size, 0)
+        pos = count = 0
+        while pos + self.HEADER.size <= len(data):
+            addr, length, kind = self.HEADER.unpack_from(data, pos)
+            payload = length if kind == self.SET else 0
+            end = pos + self.HEADER.size + payload + self.CRC.size
+            if kind not in (self.SET, self.ZERO) or end > len(data):
+                break
+            (crc,) = self.CRC.unpack_from(data, end - self.CRC.size)
+            if zlib.crc32(data[pos:end - self.CRC.size]) != crc:
+                break
+            region = self.space.find(addr, length)
+            if region is None:
+                raise ValueError(f"{self.path}: record at offset {pos} changes {addr:#x}+{length:#x},"
+                                 " outside the configured regions; restore the region config"
+                                 " that wrote it, or move the log aside to discard it")
+            body = pos + self.HEADER.size
+            if kind == self.SET:
+                region.write(addr - region.base, data[body:body + length])
+            else:
+                region.zero(addr - region.base, length)
+            pos = end
+            count += 1
+        if pos != len(data):
+            os.ftruncate(self.fd, pos)
+            os.fsync(self.fd)
+        self.size = pos
+        return count
+
+    def start(self):
+        self.thread.start()
+
+    def append(self, addr, data=None, length=0):
+        """Queue a change already made to the address space; call with mem_lock held."""
+        if data is None:
+            rec = self.HEADER.pack(addr, length, self.ZERO)
+        else:
+            rec = self.HEADER.pack(addr, len(data), self.SET) + data
+        rec += self.CRC.pack(zlib.crc32(rec))
+        with self.cond:
+            self.pending.append(rec)
+            self.seq += 1
+            self.cond.notify_all()
+            return self.seq
+
+    def wait(self, seq):
+        """Block until record seq is on disk."""
+        with self.cond:
+            while self.durable < seq and self.error is None:
+                self.cond.wait()
+            if self.error is not None:
+                raise RuntimeError("write-ahead log failed: %s" % self.error)
+
+    def close(self):
+        """Commit what is queued and checkpoint."""
+        with self.cond:
+            self.stopping = True
+            self.cond.notify_all()
+        if self.thread.is_alive():
+            self.thread.join()
+
+    def _checkpoint_due(self):
+        return self.size >= CHECKPOINT_BYTES or (
+            self.size and time.monotonic() - self.last_checkpoint >= CHECKPOINT_INTERVAL)
+
+    def _write(self, buf):
+        view = memoryview(buf)
+        while view:
+            view = view[os.write(self.fd, view):]
+
+    def _run(self):
+        try:
+            while True:
+                with self.cond:
+                    while not (self.pending or self.stopping or self._checkpoint_due()):
+                        self.cond.wait(CHECKPOINT_INTERVAL)
+                    stopping = self.stopping
+                if GROUP_COMMIT_WINDOW and not stopping:
+                    time.sleep(GROUP_COMMIT_WINDOW)
+                checkpoint = stopping or self._checkpoint_due()
+                # the batch and the snapshot are taken together, so the log
+                # always covers the files and replaying it over them is safe
+                with self.lock, self.cond:
+                    batch, self.pending = self.pending, []
+                    seq = self.seq
+                    changes = self.space.snapshot() if checkpoint else None
+                if batch:
+                    buf = b"".join(batch)
+                    self._write(buf)
+                    os.fsync(self.fd)
+                    self.size += len(buf)
+                with self.cond:
+                    self.durable = seq
+                    self.cond.notify_all()
+                if changes is not None:
+                    self.space.flush(changes)
+                    os.ftruncate(self.fd, 0)
+                    os.fsync(self.fd)
+                    self.size = 0
+                    self.last_checkpoint = time.monotonic()
+                if stopping:
+                    return
+        except OSError as e:
+            with self.cond:
+                self.error = e
+                self.cond.notify_all()
+
+mem_lock = threading.Lock()     # makes check-then-write and log order atomic
+wal = WriteAheadLog(WALFILE, space, mem_lock)
+if wal.recover():
+    space.flush(space.snapshot())
+    os.ftruncate(wal.fd, 0)
+    wal.size = 0
+wal.start()
+atexit.register(wal.close)
+
 # JSON error handlers
 @app.errorhandler(HTTPException)
 def handle_http_exception(e):
@@ -36,44 +404,53 @@ def handle_exception(e):
     payload = {"error": "InternalServerError", "message": str(e), "trace": tb}
     return jsonify(payload), 500
 
-def save_memory():
-    """Atomic save of memory to disk."""
-    tmp = MEMFILE + ".tmp"
-    with open(tmp, "wb") as f:
-        f.write(memory)
-        f.flush()
-        os.fsync(f.fileno())
-    os.replace(tmp, MEMFILE)
 
 def check(addr, width):
-    """Validate width, range, and alignment."""
+    """Validate width, range, and alignment; returns the region."""
     if width not in (1, 2, 4, 8):
         abort(400, "bad width (must be 1,2,4,8)")
-    if addr < BASE or addr + width - 1 > END:
+    region = space.find(addr, width)
+    if region is None:
         abort(403, "address out of allowed range")
-    if ((addr - BASE) % width) != 0:
+    if width not in region.widths:
+        abort(400, f"width {width} not allowed in region {region.name}")
+    if ((addr - region.base) % width) != 0:
         abort(400, "misaligned address (must be aligned to width)")
+    return region
+
+def check_writable(region):
+    if not region.writable:
+        abort(403, f"region {region.name} is read-only")
 
-def addr_sequence_from_start_end_or_count(start, end=None, count=None, width=4):
-    """Return a list of addresses from start..end inclusive stepping by width,
-       or start with count items (start + i*width)."""
+# struct codes of little-endian elements by width
+ELEMENT_FORMAT = {1: "B", 2: "H", 4: "I", 8: "Q"}
+
+def check_range(start, end=None, count=None, width=4):
+    """Validate start..end inclusive stepping by width, or count items from
+       start; returns (region, count).
+
+    Every address shares the region and alignment of the first, so besides
+    start only the first address past the region's end needs check(); the
+    errors are the ones a walk over every address would hit first."""
     if count is not None:
         if count <= 0:
             abort(400, "count must be >= 1")
-        end_calc = start + width * (count - 1)
-        end = end_calc
+        end = start + width * (count - 1)
     if end is None:
         abort(400, "either end or count must be provided")
     if end < start:
         abort(400, "end must be >= start")
-    # make sure start and end are aligned and in range via check for each
-    addrs = []
-    addr = start
-    while addr <= end:
-        check(addr, width)
-        addrs.append(addr)
-        addr += width
-    return addrs
+    region = check(start, width)
+    count = (end - start) // width + 1
+    if start + count * width - 1 > region.end:
+        over = start + ((region.end + 1 - start - width) // width + 1) * width
+        check(over, width)
+        abort(403, "range crosses a region boundary")
+    return region, count
+
+def unpack(data, width):
+    """The little-endian elements of data as a tuple of ints."""
+    return struct.unpack(f"<{len(data) // width}{ELEMENT_FORMAT[width]}", data)
 
 @app.route("/api/v1/read")
 def api_read():
@@ -86,9 +463,8 @@ def api_read():
         width = int(width_s, 0)
     except ValueError:
         abort(400, "addr/width must be integers (use 0x... for hex)")
-    check(addr, width)
-    offset = addr - BASE
-    val = int.from_bytes(memory[offset:offset + width], "little")
+    region = check(addr, width)
+    val = int.from_bytes(region.read(addr - region.base, width), "little")
     return jsonify(addr=hex(addr), width=width, value=hex(val))
 
 @app.route("/api/v1/write", methods=["POST"])
@@ -102,25 +478,26 @@ def api_write():
         value = int(j["value"], 0)
     except (KeyError, ValueError):
         abort(400, "JSON must contain addr, width, value (addr/value can be hex)")
-    check(addr, width)
-    offset = addr - BASE
+    region = check(addr, width)
+    check_writable(region)
+    offset = addr - region.base
 
-    # refuse write if existing bytes are non-zero
-    existing = memory[offset:offset + width]
-    for b in existing:
-        if b != 0:
+    with mem_lock:
+        # refuse write if existing bytes are non-zero
+        if region.write_once and not region.is_zero(offset, width):
             abort(403, "existing value is non-zero; clear before writing")
 
-    try:
-        memory[offset:offset + width] = value.to_bytes(width, "little")
-    except OverflowError:
-        abort(400, "value too large for given width")
-    save_memory()
+        try:
+            data = value.to_bytes(width, "little")
+        except OverflowError:
+            abort(400, "value too large for given width")
+        region.write(offset, data)
+        seq = wal.append(addr, data)
+    wal.wait(seq)
     return jsonify(status="ok", addr=hex(addr), width=width, value=hex(value))
 
-@app.route("/api/v1/read_range")
-def api_read_range():
-    # supports start+end OR start+count
+def range_args():
+    """start, end, count and width of a range query (start+end OR start+count)."""
     start_s = request.args.get("start")
     end_s = request.args.get("end")
     count_s = request.args.get("count")
@@ -144,13 +521,16 @@ def api_read_range():
             count = int(count_s, 0)
         except ValueError:
             abort(400, "count must be integer")
-    addrs = addr_sequence_from_start_end_or_count(start, end=end, count=count, width=width)
-    result = {}
-    for addr in addrs:
-        offset = addr - BASE
-        val = int.from_bytes(memory[offset:offset + width], "little")
-        result[hex(addr)] = hex(val)
-    return jsonify(status="ok", width=width, count=len(addrs), data=result)
+    return start, end, count, width
+
+@app.route("/api/v1/read_range")
+def api_read_range():
+    start, end, count, width = range_args()
+    region, count = check_range(start, end=end, count=count, width=width)
+    values = unpack(region.read(start - region.base, count * width), width)
+    addrs = range(start, start + count * width, width)
+    result = {hex(addr): hex(val) for addr, val in zip(addrs, values)}
+    return jsonify(status="ok", width=width, count=count, data=result)
 
 @app.route("/api/v1/write_range", methods=["POST"])
 def api_write_range():
@@ -173,14 +553,14 @@ def api_write_range():
         width = int(j.get("width", 4))
     except (KeyError, ValueError):
         abort(400, "JSON must contain start (hex), count (int), optional width (int)")
-    # build address list
-    addrs = addr_sequence_from_start_end_or_count(start, count=count, width=width)
+    region, count = check_range(start, count=count, width=width)
+    addrs = range(start, start + count * width, width)
     # decide values
     values = None
     if "values" in j:
         if not isinstance(j["values"], list):
             abort(400, "values must be a list")
-        if len(j["values"]) != len(addrs):
+        if len(j["values"]) != count:
             abort(400, "values list length must equal count")
         try:
             values = [int(x, 0) for x in j["values"]]
@@ -191,31 +571,33 @@ def api_write_range():
             v = int(j["value"], 0)
         except ValueError:
             abort(400, "value must be integer")
-        values = [v] * len(addrs)
+        values = [v] * count
     else:
         abort(400, "provide either 'values' list or single 'value'")
 
-    # Ensure none of the target slots are non-zero
-    offending = []
-    for addr in addrs:
-        offset = addr - BASE
-        existing = memory[offset:offset + width]
-        if any(b != 0 for b in existing):
-            offending.append(hex(addr))
-    if offending:
-        abort(403, "existing non-zero at addresses: " + ",".join(offending))
-
-    # perform writes
-    written = []
-    for addr, val in zip(addrs, values):
-        offset = addr - BASE
+    check_writable(region)
+    offset = start - region.base
+    with mem_lock:
+        # Ensure none of the target slots are non-zero; one test for the
+        # whole range, the offenders are only looked up when it fails
+        if region.write_once and not region.is_zero(offset, count * width):
+            current = unpack(region.read(offset, count * width), width)
+            offending = [hex(addr) for addr, val in zip(addrs, current) if val]
+            abort(403, "existing non-zero at addresses: " + ",".join(offending))
+
+        # encode everything first so a bad value leaves nothing half-written
         try:
-            memory[offset:offset + width] = int(val).to_bytes(width, "little")
-        except OverflowError:
-            abort(400, f"value {val} too large for width {width} at addr {hex(addr)}")
-        written.append({"addr": hex(addr), "value": hex(int(val))})
-    save_memory()
-    return jsonify(status="ok", count=len(written), written=written)
+            data = struct.pack(f"<{count}{ELEMENT_FORMAT[width]}", *values)
+        except struct.error:
+            for addr, val in zip(addrs, values):
+                if not 0 <= val < 1 << (8 * width):
+                    abort(400, f"value {val} too large for width {width} at addr {hex(addr)}")
+            raise
+        region.write(offset, data)
+        seq = wal.append(start, data)
+    wal.wait(seq)
+    written = [{"addr": hex(addr), "value": hex(val)} for addr, val in zip(addrs, values)]
+    return jsonify(status="ok", count=count, written=written)
 
 @app.route("/api/v1/clear")
 def api_clear():
@@ -228,10 +610,12 @@ def api_clear():
         width = int(width_s, 0)
     except ValueError:
         abort(400, "addr/width must be integers")
-    check(addr, width)
-    offset = addr - BASE
-    memory[offset:offset + width] = (0).to_bytes(width, "little")
-    save_memory()
+    region = check(addr, width)
+    check_writable(region)
+    with mem_lock:
+        region.zero(addr - region.base, width)
+        seq = wal.append(addr, length=width)
+    wal.wait(seq)
     return jsonify(status="cleared", addr=hex(addr), width=width, value="0x0")
 
 @app.route("/api/v1/clear_range", methods=["POST"])
@@ -245,24 +629,127 @@ def api_clear_range():
         abort(400, "JSON must contain start,end,width")
     if end < start:
         abort(400, "end must be >= start")
-    addrs = addr_sequence_from_start_end_or_count(start, end=end, width=width)
-    for addr in addrs:
-        offset = addr - BASE
-        memory[offset:offset + width] = (0).to_bytes(width, "little")
-    save_memory()
-    return jsonify(status="cleared_range", start=hex(start), end=hex(end), width=width, count=len(addrs))
+    region, count = check_range(start, end=end, width=width)
+    check_writable(region)
+    with mem_lock:
+        region.zero(start - region.base, count * width)
+        seq = wal.append(start, length=count * width)
+    wal.wait(seq)
+    return jsonify(status="cleared_range", start=hex(start), end=hex(end), width=width, count=count)
 
 @app.route("/api/v1/clear_all", methods=["POST"])
 def api_clear_all():
     j = request.get_json(silent=True)
     if not j or j.get("confirm") is not True:
         abort(400, "must POST JSON {\"confirm\": true} to clear all")
-    for i in range(SIZE):
-        memory[i] = 0
-    save_memory()
-    return jsonify(status="cleared_all", size=SIZE, base=hex(BASE))
+    # read-only regions keep their contents
+    regions = [r for r in space.regions if r.writable]
+    seq = 0
+    with mem_lock:
+        for r in regions:
+            r.clear()
+            seq = wal.append(r.base, length=r.size)
+    wal.wait(seq)
+    return jsonify(status="cleared_all", size=sum(r.size for r in regions),
+                   base=hex(space.regions[0].base))
+
+def wants_gzip():
+    return request.accept_encodings["gzip"] > 0
+
+@app.route("/api/v1/read_bin")
+def api_read_bin():
+    """
+    GET ?start=..&count=N|end=..&width=4 -> application/octet-stream
+    The range as packed little-endian elements, streamed in BIN_CHUNK
+    pieces with chunked transfer encoding; gzip-compressed when the
+    client sends Accept-Encoding: gzip.
+    """
+    start, end, count, width = range_args()
+    region, count = check_range(start, end=end, count=count, width=width)
+    offset = start - region.base
+    length = count * width
+    compress = zlib.compressobj(6, zlib.DEFLATED, 31) if wants_gzip() else None
+
+    def generate():
+        for done in range(0, length, BIN_CHUNK):
+            chunk = bytes(region.read(offset + done, min(BIN_CHUNK, length - done)))
+            if compress is None:
+                yield chunk
+            else:
+                out = compress.compress(chunk)
+                if out:
+                    yield out
+        if compress is not None:
+            yield compress.flush()
+
+    headers = {"Vary": "Accept-Encoding", "X-Start": hex(start), "X-Width": str(width),
+               "X-Count": str(count)}
+    if compress is not None:
+        headers["Content-Encoding"] = "gzip"
+    return Response(stream_with_context(generate()), mimetype="application/octet-stream",
+                    headers=headers)
+
+@app.route("/api/v1/write_bin", methods=["POST"])
+def api_write_bin():
+    """
+    POST ?start=..&width=4 with an application/octet-stream body of packed
+    little-endian elements (plain or chunked; Content-Encoding: gzip or
+    deflate accepted). The element count is the body length / width; the
+    same range, alignment and write-once rules as write_range apply.
+    """
+    start_s = request.args.get("start")
+    width_s = request.args.get("width", "4")
+    if not start_s:
+        abort(400, "start parameter required")
+    try:
+        start = int(start_s, 0)
+        width = int(width_s, 0)
+    except ValueError:
+        abort(400, "start/width must be integers")
+    region = check(start, width)
+    limit = region.end + 1 - start      # nothing past the region is accepted
+
+    encoding = request.headers.get("Content-Encoding", "identity").lower()
+    if encoding not in ("identity", "gzip", "deflate"):
+        abort(415, f"unsupported Content-Encoding {encoding}")
+    # wbits 47 accepts both gzip and zlib headers
+    inflate = zlib.decompressobj(47) if encoding != "identity" else None
+    data = bytearray()
+    try:
+        while True:
+            chunk = request.stream.read(BIN_CHUNK)
+            if not chunk:
+                break
+            if inflate is not None:
+                chunk = inflate.decompress(chunk, limit + 1 - len(data))
+            data += chunk
+            if len(data) > limit:
+                abort(403, "address out of allowed range")
+        if inflate is not None and not inflate.eof:
+            abort(400, "truncated compressed body")
+    except zlib.error:
+        abort(400, "bad compressed body")
+    if len(data) % width:
+        abort(400, "body length must be a multiple of width")
+
+    region, count = check_range(start, count=len(data) // width, width=width)
+    check_writable(region)
+    offset = start - region.base
+    with mem_lock:
+        if region.write_once and not region.is_zero(offset, len(data)):
+            current = unpack(region.read(offset, len(data)), width)
+            addrs = range(start, start + len(data), width)
+            offending = [hex(addr) for addr, val in zip(addrs, current) if val]
+            more = ",..." if len(offending) > 16 else ""
+            abort(403, "existing non-zero at addresses: " + ",".join(offending[:16]) + more)
+        region.write(offset, data)
+        seq = wal.append(start, bytes(data))
+    wal.wait(seq)
+    return jsonify(status="ok", start=hex(start), width=width, count=count)
 
 if __name__ == "__main__":
+    # exit through atexit so the log gets its final checkpoint
+    signal.signal(signal.SIGTERM, lambda signum, frame: sys.exit(0))
     context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
     context.load_cert_chain("certs/server.crt", "certs/server.key")
     app.run(host="0.0.0.0", port=8443, ssl_context=context, threaded=True)
@@ -4,41 +4,197 @@
 #include <linux/io.h>
 #include <linux/seq_file.h>
 
-#define TARGET_ADDR 0xFE000000
-#define MAP_SIZE    0x1000
+#define WORDS_PER_LINE 4
+
+static unsigned long base = 0xFE000000;
+module_param(base, ulong, 0444);
+MODULE_PARM_DESC(base, "Physical address of the register block");
+
+static unsigned int size = 0x1000;
+module_param(size, uint, 0444);
+MODULE_PARM_DESC(size, "Bytes to map, a multiple of 4");
 
 static void __iomem *mapped;
 
-static int diag_proc_read(struct seq_file *file, void *v) {
-    unsigned int value = ioread32(mapped);
-    seq_printf(file, "Value at 0x%x = 0x%08x\n", TARGET_ADDR, value);
+/*
+ * Sub-window shown through one open file of /proc/diag_read, as a byte
+ * offset and length into the mapping. Writing "<addr> <len>" to the file
+ * selects one, "all" the whole block; other readers are unaffected.
+ */
+struct diag_window {
+    unsigned int off;
+    unsigned int len;
+};
+
+/*
+ * /proc/diag_read streams the file's window, WORDS_PER_LINE words per
+ * line after a header; *pos is the line number. seq_read() holds m->lock
+ * around these, which the write side takes too.
+ */
+static void *diag_seq_start(struct seq_file *m, loff_t *pos) {
+    struct diag_window *w = m->private;
+
+    if (*pos == 0)
+        return SEQ_START_TOKEN;
+    return *pos <= DIV_ROUND_UP(w->len, WORDS_PER_LINE * 4) ? pos : NULL;
+}
+
+static void *diag_seq_next(struct seq_file *m, void *v, loff_t *pos) {
+    struct diag_window *w = m->private;
+
+    ++*pos;
+    return *pos <= DIV_ROUND_UP(w->len, WORDS_PER_LINE * 4) ? pos : NULL;
+}
+
+static void diag_seq_stop(struct seq_file *m, void *v) {
+}
+
+static int diag_seq_show(struct seq_file *m, void *v) {
+    struct diag_window *w = m->private;
+    unsigned int off, end, i;
+
+    if (v == SEQ_START_TOKEN) {
+        seq_printf(m, "# 0x%lx-0x%lx of 0x%lx-0x%lx\n", base + w->off,
+                   base + w->off + w->len - 1, base, base + size - 1);
+        return 0;
+    }
+
+    off = w->off + (*(loff_t *)v - 1) * WORDS_PER_LINE * 4;
+    end = min(off + WORDS_PER_LINE * 4, w->off + w->len);
+    seq_printf(m, "0x%08lx:", base + off);
+    for (i = off; i < end; i += 4)
+        seq_printf(m, " %08x", ioread32(mapped + i));
+    seq_putc(m, '\n');
     return 0;
 }
 
+static const struct seq_operations diag_seq_ops = {
+    .start = diag_seq_start,
+    .next  = diag_seq_next,
+    .stop  = diag_seq_stop,
+    .show  = diag_seq_show,
+};
+
 static int diag_proc_open(struct inode *inode, struct file *file) {
-    return single_open(file, diag_proc_read, NULL);
+    struct diag_window *w;
+
+    w = __seq_open_private(file, &diag_seq_ops, sizeof(*w));
+    if (!w)
+        return -ENOMEM;
+    w->len = size;
+    return 0;
+}
+
+static ssize_t diag_proc_write(struct file *file, const char __user *ubuf,
+                               size_t count, loff_t *ppos) {
+    struct seq_file *m = file->private_data;
+    struct diag_window *w = m->private;
+    unsigned long addr, len;
+    char buf[64];
+
+    if (count >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, count))
+        return -EFAULT;
+    buf[count] = '\0';
+
+    if (sysfs_streq(buf, "all")) {
+        addr = base;
+        len = size;
+    } else if (sscanf(buf, "%lx %lx", &addr, &len) != 2) {
+        return -EINVAL;
+    }
+
+    if (addr % 4 || len % 4 || !len || addr < base || addr - base >= size ||
+        len > size - (addr - base))
+        return -EINVAL;
+
+    // a new window is read from its first line, not where the old one stopped
+    mutex_lock(&m->lock);
+    w->off = addr - base;
+    w->len = len;
+    m->index = 0;
+    m->read_pos = 0;
+    m->count = 0;
+    m->from = 0;
+    *ppos = 0;
+    mutex_unlock(&m->lock);
+    return count;
 }
 
 static const struct proc_ops diag_proc_fops = {
     .proc_open = diag_proc_open,
     .proc_read = seq_read,
+    .proc_write = diag_proc_write,
     .proc_lseek = seq_lseek,
-    .proc_release = single_release,
+    .proc_release = seq_release_private,
+};
+
+/*
+ * /proc/diag_read_bin: the whole block as raw little-endian words, file
+ * offset = offset into the block, so one pread() snapshots any part of it.
+ */
+static ssize_t diag_bin_read(struct file *file, char __user *ubuf, size_t count,
+                             loff_t *ppos) {
+    u32 chunk[64];
+    loff_t pos = *ppos;
+    size_t done = 0, n, i;
+
+    if (pos % 4 || count % 4)
+        return -EINVAL;
+    if (pos >= size)
+        return 0;
+    count = min_t(size_t, count, size - pos);
+
+    while (done < count) {
+        n = min(count - done, sizeof(chunk));
+        for (i = 0; i < n / 4; i++)
+            chunk[i] = cpu_to_le32(ioread32(mapped + pos + done + i * 4));
+        if (copy_to_user(ubuf + done, chunk, n))
+            return done ? done : -EFAULT;
+        done += n;
+    }
+    *ppos = pos + done;
+    return done;
+}
+
+static const struct proc_ops diag_bin_fops = {
+    .proc_read = diag_bin_read,
+    .proc_lseek = default_llseek,
 };
 
 static int __init diag_init(void) {
-    mapped = ioremap(TARGET_ADDR, MAP_SIZE);
+    struct proc_dir_entry *bin;
+
+    if (!size || size % 4) {
+        pr_err("size must be a non-zero multiple of 4\n");
+        return -EINVAL;
+    }
+
+    mapped = ioremap(base, size);
     if (!mapped) {
         pr_err("Failed to map DDR address\n");
         return -ENOMEM;
     }
 
-    proc_create("diag_read", 0, NULL, &diag_proc_fops);
-    pr_info("diag_read module loaded\n");
+    if (!proc_create("diag_read", 0644, NULL, &diag_proc_fops)) {
+        iounmap(mapped);
+        return -ENOMEM;
+    }
+    bin = proc_create("diag_read_bin", 0444, NULL, &diag_bin_fops);
+    if (!bin) {
+        remove_proc_entry("diag_read", NULL);
+        iounmap(mapped);
+        return -ENOMEM;
+    }
+    proc_set_size(bin, size);
+
+    pr_info("diag_read module loaded (0x%lx, %u bytes)\n", base, size);
     return 0;
 }
 
 static void __exit diag_exit(void) {
+    remove_proc_entry("diag_read_bin", NULL);
     remove_proc_entry("diag_read", NULL);
     iounmap(mapped);
     pr_info("diag_read module unloaded\n");
@@ -47,4 +203,3 @@ static void __exit diag_exit(void) {
 module_init(diag_init);
 module_exit(diag_exit);
 MODULE_LICENSE("GPL");
-
@@ -1,19 +1,494 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #define MAP_SIZE 4096UL
 #define MAP_MASK (MAP_SIZE - 1)
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        printf("Usage: %s <physical_address_in_hex>\n", argv[0]);
+/*
+ * Daemon mode keeps windows mapped between requests. Windows mapped on
+ * demand are WIN_SIZE bytes, aligned; up to MAX_WINDOWS stay mapped and
+ * the oldest on-demand one is dropped when a new one is needed.
+ */
+#define WIN_SIZE     (1UL << 20)
+#define MAX_WINDOWS  64
+#define MAX_CLIENTS  64
+#define MAX_DUMP     4096       // elements per "d" request
+#define IO_BUF       (1 << 16)
+#define OUT_MAX      (1 << 20)  // unsent reply bytes before a client's input is paused
+
+struct window {
+    unsigned long base;
+    unsigned long size;
+    volatile uint8_t *virt;
+    int pinned;                 // from --window, never evicted
+};
+
+
+static int mem_fd = -1;
+static int writable;
+static struct window windows[MAX_WINDOWS];
+static int nwindows;
+static int next_evict;
+static struct window *last_hit;
+
+static struct window *map_window(unsigned long base, unsigned long size, int pinned) {
+    int prot = PROT_READ | (writable ? PROT_WRITE : 0);
+    struct window *w;
+    void *virt;
+    int i;
+
+    virt = mmap(NULL, size, prot, MAP_SHARED, mem_fd, base);
+    if (virt == MAP_FAILED)
+        return NULL;
+
+    if (nwindows < MAX_WINDOWS) {
+        w = &windows[nwindows++];
+    } else {
+        // round-robin over the on-demand windows
+        for (i = 0; i < MAX_WINDOWS && windows[next_evict].pinned; i++)
+            next_evict = (next_evict + 1) % MAX_WINDOWS;
+        if (windows[next_evict].pinned) {
+            munmap(virt, size);
+            return NULL;
+        }
+        w = &windows[next_evict];
+        next_evict = (next_evict + 1) % MAX_WINDOWS;
+        munmap((void *)w->virt, w->size);
+        if (last_hit == w)
+            last_hit = NULL;
+    }
+    w->base = base;
+    w->size = size;
+    w->virt = virt;
+    w->pinned = pinned;
+    return w;
+}
+
+/* Local address of [addr, addr + len), mapping a window if needed. */
+static volatile uint8_t *lookup(unsigned long addr, unsigned long len) {
+    struct window *w = last_hit;
+    int i;
+
+    if (w && addr - w->base < w->size && len <= w->size - (addr - w->base))
+        return w->virt + (addr - w->base);
+
+    for (i = 0; i < nwindows; i++) {
+        w = &windows[i];
+        if (addr - w->base < w->size && len <= w->size - (addr - w->base)) {
+            last_hit = w;
+            return w->virt + (addr - w->base);
+        }
+    }
+
+    // a request straddling two on-demand windows gets its own mapping
+    w = map_window(addr & ~(WIN_SIZE - 1), WIN_SIZE, 0);
+    if (!w || len > w->size - (addr - w->base)) {
+        unsigned long base = addr & ~MAP_MASK;
+
+        w = map_window(base, ((addr + len - base) + MAP_MASK) & ~MAP_MASK, 0);
+        if (!w)
+            return NULL;
+    }
+    last_hit = w;
+    return w->virt + (addr - w->base);
+}
+
+static uint64_t load(volatile uint8_t *p, int width) {
+    switch (width) {
+    case 1: return *p;
+    case 2: return *(volatile uint16_t *)p;
+    case 8: return *(volatile uint64_t *)p;
+    default: return *(volatile uint32_t *)p;
+    }
+}
+
+static void store(volatile uint8_t *p, int width, uint64_t value) {
+    switch (width) {
+    case 1: *p = value; break;
+    case 2: *(volatile uint16_t *)p = value; break;
+    case 8: *(volatile uint64_t *)p = value; break;
+    default: *(volatile uint32_t *)p = value; break;
+    }
+}
+
+// Replies waiting to be sent to one client
+struct out {
+    char *buf;
+    size_t len, cap;
+};
+
+struct client {
+    int fd;
+    int quit;                   // "q" seen or end of input
+    int eof;
+    char in[IO_BUF];
+    size_t in_len;
+    struct out out;
+    size_t out_off;             // bytes of out already sent
+};
+
+static void out_reserve(struct out *o, size_t n) {
+    if (o->len + n <= o->cap)
+        return;
+    o->cap = (o->len + n) * 2;
+    o->buf = realloc(o->buf, o->cap);
+    if (!o->buf) {
+        perror("realloc");
+        exit(1);
+    }
+}
+
+static void out_str(struct out *o, const char *s) {
+    size_t n = strlen(s);
+
+    out_reserve(o, n);
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+
+// Hand-rolled hex: printf dominates the cost of a read otherwise
+static void out_hex(struct out *o, uint64_t v, int width) {
+    static const char digits[] = "0123456789abcdef";
+    int i, n = width * 2;
+
+    out_reserve(o, n + 3);
+    o->buf[o->len++] = '0';
+    o->buf[o->len++] = 'x';
+    for (i = n - 1; i >= 0; i--)
+        o->buf[o->len++] = digits[(v >> (i * 4)) & 0xf];
+}
+
+static int parse_width(const char *s, int *width) {
+    *width = s ? atoi(s) : 4;
+    return *width == 1 || *width == 2 || *width == 4 || *width == 8 ? 0 : -1;
+}
+
+/*
+ * One request line. Replies are a single line each:
+ *   r <addr> [width]          -> ok <value>
+ *   w <addr> <value> [width]  -> ok            (--rw only)
+ *   d <addr> <count> [width]  -> ok <v0> <v1> ...
+ *   q                         -> closes the connection
+ * and "err <reason>" on failure. Numbers take any strtoul base prefix.
+ */
+static int handle_line(char *line, struct out *o) {
+    char *argv[5], *save = NULL, *tok;
+    volatile uint8_t *p;
+    unsigned long addr, count, i;
+    uint64_t value;
+    int argc = 0, width;
+
+    for (tok = strtok_r(line, " \t\r", &save); tok && argc < 5; tok = strtok_r(NULL, " \t\r", &save))
+        argv[argc++] = tok;
+    if (argc == 0)
+        return 0;
+
+    if (strcmp(argv[0], "q") == 0)
+        return -1;
+
+    if (argc < 2 || strlen(argv[0]) != 1 || !strchr("rwd", argv[0][0])) {
+        out_str(o, "err bad request\n");
+        return 0;
+    }
+
+    addr = strtoul(argv[1], NULL, 0);
+    switch (argv[0][0]) {
+    case 'r':
+        if (parse_width(argc > 2 ? argv[2] : NULL, &width) < 0)
+            goto bad_width;
+        if (addr % width)
+            goto misaligned;
+        p = lookup(addr, width);
+        if (!p)
+            goto unmapped;
+        out_str(o, "ok ");
+        out_hex(o, load(p, width), width);
+        out_str(o, "\n");
+        return 0;
+
+    case 'w':
+        if (argc < 3) {
+            out_str(o, "err missing value\n");
+            return 0;
+        }
+        if (!writable) {
+            out_str(o, "err read-only (start with --rw)\n");
+            return 0;
+        }
+        if (parse_width(argc > 3 ? argv[3] : NULL, &width) < 0)
+            goto bad_width;
+        if (addr % width)
+            goto misaligned;
+        value = strtoull(argv[2], NULL, 0);
+        if (width < 8 && value >> (width * 8)) {
+            out_str(o, "err value too large for width\n");
+            return 0;
+        }
+        p = lookup(addr, width);
+        if (!p)
+            goto unmapped;
+        store(p, width, value);
+        out_str(o, "ok\n");
+        return 0;
+
+    case 'd':
+        if (argc < 3) {
+            out_str(o, "err missing count\n");
+            return 0;
+        }
+        if (parse_width(argc > 3 ? argv[3] : NULL, &width) < 0)
+            goto bad_width;
+        if (addr % width)
+            goto misaligned;
+        count = strtoul(argv[2], NULL, 0);
+        if (count == 0 || count > MAX_DUMP) {
+            out_str(o, "err count must be 1..4096\n");
+            return 0;
+        }
+        p = lookup(addr, count * width);
+        if (!p)
+            goto unmapped;
+        out_str(o, "ok");
+        for (i = 0; i < count; i++) {
+            out_str(o, " ");
+            out_hex(o, load(p + i * width, width), width);
+        }
+        out_str(o, "\n");
+        return 0;
+    }
+    return 0;
+
+bad_width:
+    out_str(o, "err width must be 1, 2, 4 or 8\n");
+    return 0;
+misaligned:
+    out_str(o, "err misaligned address\n");
+    return 0;
+unmapped:
+    out_str(o, "err mmap failed\n");
+    return 0;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    ssize_t n;
+
+    while (len) {
+        n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == ENOTSOCK)
+            n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Read what is available into c->in; -1 on a read error. */
+static int read_input(struct client *c) {
+    ssize_t n;
+
+    n = read(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return 0;
+    if (n < 0)
+        return -1;
+    c->eof = n == 0;
+    c->in_len += n;
+    return 0;
+}
+
+/*
+ * Answer complete lines from c->in into c->out, so the replies to a
+ * pipelined batch go out with one write. Stops at "q" and once OUT_MAX
+ * reply bytes are unsent; returns 1 if complete lines were left over.
+ */
+static int answer_lines(struct client *c) {
+    char *line = c->in, *nl;
+    int more = 0;
+
+    while (!c->quit && (nl = memchr(line, '\n', c->in + c->in_len - line))) {
+        if (c->out.len - c->out_off > OUT_MAX) {
+            more = 1;
+            break;
+        }
+        *nl = '\0';
+        c->quit = handle_line(line, &c->out) < 0;
+        line = nl + 1;
+    }
+    c->in_len -= line - c->in;
+    memmove(c->in, line, c->in_len);
+
+    if (!more && c->in_len == sizeof(c->in)) {
+        out_str(&c->out, "err line too long\n");
+        c->in_len = 0;
+    }
+    c->quit |= c->eof && !more;
+    return more;
+}
+
+/* Send what the socket takes without blocking; -1 if the client is gone. */
+static int flush_out(struct client *c) {
+    ssize_t n;
+
+    while (c->out_off < c->out.len) {
+        n = send(c->fd, c->out.buf + c->out_off, c->out.len - c->out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN ? 0 : -1;
+        }
+        c->out_off += n;
+    }
+    c->out.len = c->out_off = 0;
+    return 0;
+}
+
+static void drop_client(struct client *c) {
+    close(c->fd);
+    free(c->out.buf);
+    free(c);
+}
+
+static int listen_unix(const char *path) {
+    struct sockaddr_un sun = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen(path) >= sizeof(sun.sun_path)) {
+        fprintf(stderr, "socket path too long\n");
+        return -1;
+    }
+    strcpy(sun.sun_path, path);
+    unlink(path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0 || listen(fd, 16) < 0) {
+        perror("socket");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Clients are non-blocking and each has its own reply buffer, flushed on
+ * POLLOUT, so one that stops reading only stalls itself. Its requests
+ * are left unanswered, and its input unread, while OUT_MAX reply bytes
+ * are waiting.
+ */
+static int serve_socket(const char *path) {
+    struct pollfd pfd[MAX_CLIENTS + 1];
+    struct client *clients[MAX_CLIENTS + 1] = { 0 };
+    struct client *c;
+    size_t pending;
+    int nfds = 1, lfd, fd, i, drop, more;
+
+    lfd = listen_unix(path);
+    if (lfd < 0)
         return 1;
+    pfd[0].fd = lfd;
+    pfd[0].events = POLLIN;
+
+    for (;;) {
+        if (poll(pfd, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+
+        if (pfd[0].revents & POLLIN) {
+            fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            c = fd >= 0 && nfds <= MAX_CLIENTS ? calloc(1, sizeof(*c)) : NULL;
+            if (c) {
+                c->fd = fd;
+                clients[nfds] = c;
+                pfd[nfds].fd = fd;
+                pfd[nfds].events = POLLIN;
+                pfd[nfds].revents = 0;
+                nfds++;
+            } else if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        for (i = 1; i < nfds; i++) {
+            if (!pfd[i].revents)
+                continue;
+            c = clients[i];
+            drop = 0;
+            if ((pfd[i].events & POLLIN) && (pfd[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                drop = read_input(c) < 0;
+            // lines held back by OUT_MAX are answered as the replies drain
+            while (!drop) {
+                more = answer_lines(c);
+                drop = flush_out(c) < 0;
+                if (!more || c->out.len)
+                    break;
+            }
+
+            pending = c->out.len - c->out_off;
+            if (!drop && (!c->quit || pending)) {
+                pfd[i].events = (c->quit || c->eof || more ? 0 : POLLIN) |
+                                (pending ? POLLOUT : 0);
+                continue;
+            }
+            drop_client(c);
+            // move the last client into the hole and look at it again
+            nfds--;
+            clients[i] = clients[nfds];
+            pfd[i] = pfd[nfds];
+            i--;
+        }
+    }
+    close(lfd);
+    unlink(path);
+    return 1;
+}
+
+static int serve_stdin(void) {
+    static struct client c = { .fd = STDIN_FILENO };
+    int more;
+
+    while (!c.quit && read_input(&c) == 0) {
+        do {
+            more = answer_lines(&c);
+            if (c.out.len && write_all(STDOUT_FILENO, c.out.buf, c.out.len) < 0)
+                goto out;
+            c.out.len = 0;
+        } while (more);
     }
+out:
+    free(c.out.buf);
+    return 0;
+}
 
-    off_t addr = strtoul(argv[1], NULL, 16);
+static void usage(const char *prog) {
+    printf("Usage: %s <physical_address_in_hex>\n", prog);
+    printf("       %s --serve [--socket PATH] [--window BASE:SIZE]... [--rw]\n", prog);
+    printf("  Serves requests on stdin/stdout, or on a Unix socket, one per line:\n");
+    printf("    r <addr> [width]   w <addr> <value> [width]   d <addr> <count> [width]   q\n");
+    printf("  width is 1, 2, 4 or 8 (default 4). --window maps a range up front.\n");
+}
+
+static int read_once(const char *arg) {
+    off_t addr = strtoul(arg, NULL, 16);
 
     int fd = open("/dev/mem", O_RDONLY | O_SYNC);
     if (fd < 0) {
@@ -35,3 +510,66 @@ int main(int argc, char *argv[]) {
     close(fd);
     return 0;
 }
+
+int main(int argc, char *argv[]) {
+    static const struct option longopts[] = {
+        { "serve",  no_argument,       NULL, 'S' },
+        { "socket", required_argument, NULL, 's' },
+        { "window", required_argument, NULL, 'W' },
+        { "rw",     no_argument,       NULL, 'w' },
+        { "help",   no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    const char *windows_arg[MAX_WINDOWS];
+    const char *socket_path = NULL;
+    unsigned long base, size;
+    int serve = 0, nwin = 0, opt, i;
+    char *colon;
+
+    if (argc == 2 && argv[1][0] != '-')
+        return read_once(argv[1]);
+
+    while ((opt = getopt_long(argc, argv, "", longopts, NULL)) != -1) {
+        switch (opt) {
+        case 'S': serve = 1; break;
+        case 's': socket_path = optarg; break;
+        case 'w': writable = 1; break;
+        case 'W':
+            if (nwin == MAX_WINDOWS) {
+                fprintf(stderr, "too many windows\n");
+                return 1;
+            }
+            windows_arg[nwin++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!serve || optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    mem_fd = open("/dev/mem", (writable ? O_RDWR : O_RDONLY) | O_SYNC | O_CLOEXEC);
+    if (mem_fd < 0) {
+        perror("open");
+        return 1;
+    }
+
+    for (i = 0; i < nwin; i++) {
+        base = strtoul(windows_arg[i], &colon, 0);
+        size = *colon == ':' ? strtoul(colon + 1, NULL, 0) : 0;
+        if (!size || (base | size) & MAP_MASK) {
+            fprintf(stderr, "--window %s: need page-aligned BASE:SIZE\n", windows_arg[i]);
+            return 1;
+        }
+        if (!map_window(base, size, 1)) {
+            perror("mmap");
+            return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    return socket_path ? serve_socket(socket_path) : serve_stdin();
+}